@@ -0,0 +1,31 @@
+#include "model/alloc_tracker.h"
+
+#include <cstdlib>
+#include <new>
+
+//Global operator new replacement that feeds AllocationTracker; only the
+//counting is added. It replaces operator new for the whole executable, so
+//this file is compiled into the test and bench executables only, never into
+//the model library or anything built on it.
+#ifndef PRODUCTION_BUILD
+namespace {
+bool const installed = (AllocationTracker::hooked_ = true);
+}
+
+void* operator new(size_t size) {
+    AllocationTracker::onAllocate(size);
+    if(void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new(size_t size, std::nothrow_t const&) noexcept {
+    AllocationTracker::onAllocate(size);
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](size_t size, std::nothrow_t const& tag) noexcept { return operator new(size, tag); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+#endif
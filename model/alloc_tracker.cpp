@@ -0,0 +1,47 @@
+#include "model/alloc_tracker.h"
+#include "model/graph.h"
+
+#include <stdexcept>
+#include <string>
+
+AllocationTracker::Scope*& AllocationTracker::current() {
+    static thread_local Scope* scope = nullptr;
+    return scope;
+}
+
+AllocationTracker::Scope::Scope(SourceNode const* source)
+    : source_(source), previous_(current()) {
+    if(source_)
+        current() = this;
+}
+
+AllocationTracker::Scope::~Scope() {
+    if(source_)
+        current() = previous_;
+}
+
+void AllocationTracker::Scope::check() {
+    if(allocations_ == 0)
+        return;
+    uint64_t n = allocations_;
+    Node const* first = firstNode_;
+    Pause pause;
+    throw std::logic_error("SourceNode::fire of " + source_->getName() + " allocated "
+        + std::to_string(n) + " times, first while firing "
+        + (first ? first->getName() : std::string("the source")));
+}
+
+AllocationTracker::Pause::Pause() : paused_(current()) { current() = nullptr; }
+AllocationTracker::Pause::~Pause() { current() = paused_; }
+
+void AllocationTracker::onAllocate(size_t) {
+    Scope* scope = current();
+    if(not scope)
+        return;
+    if(scope->allocations_++ == 0)
+        scope->firstNode_ = const_cast<SourceNode*>(scope->source_)->currentNode();
+}
+
+bool AllocationTracker::hooked_ = false;
+
+bool AllocationTracker::enabled() { return hooked_; }
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct Node;
+struct SourceNode;
+
+//Counts heap allocations made by the current thread while a Scope is open.
+//The counting happens in the global operator new replacement in
+//alloc_hook.cpp, which only the test and bench executables link; without it
+//nothing is counted and enabled() is false.
+//
+//Only the thread that opened the Scope is counted, so nodes fired on worker
+//threads by Graph::setLevelParallel aren't checked.
+//
+//Graph::setAllocationCheck opens a Scope around every SourceNode::fire after
+//warm-up, and fire() throws if anything was allocated, naming the node that
+//was firing at the first allocation.
+struct AllocationTracker {
+    struct Scope {
+        //No-op when source is null.
+        explicit Scope(SourceNode const* source);
+        ~Scope();
+        Scope(Scope const&) = delete;
+
+        uint64_t allocations() const { return allocations_; }
+        Node const* firstNode() const { return firstNode_; }
+        //Throws std::logic_error if anything was allocated since construction.
+        void check();
+
+        private:
+        friend AllocationTracker;
+        SourceNode const* source_;
+        Scope* previous_;
+        uint64_t allocations_{0};
+        Node const* firstNode_{nullptr};
+    };
+
+    //Stops counting until destroyed, for diagnostics that are allowed to allocate.
+    struct Pause {
+        Pause();
+        ~Pause();
+        Pause(Pause const&) = delete;
+        Scope* paused_;
+    };
+
+    //Called by the operator new hook.
+    static void onAllocate(size_t size);
+    static bool enabled(); //false if alloc_hook.cpp isn't linked in
+    static bool hooked_; //set by alloc_hook.cpp
+
+    private:
+    static Scope*& current();
+};
@@ -0,0 +1,125 @@
+#include <benchmark/benchmark.h>
+
+#include "model/bench/bench_utils.h"
+#include "model/graph.h"
+#include "model/theos.h"
+#include "model/test/mock_event_source_market_data.h"
+#include "model/test/utils.h"
+
+//Engine benchmarks: SourceNode::fire over synthetic graphs, and the cost of
+//building graphs and recomputing firing orders.
+
+namespace {
+
+struct BenchGraph : TestGraph {
+    BenchGraph() : TestGraph("BENCH:SYN", 1.) {}
+};
+
+enum class Mode { SERIAL, EVENT_DRIVEN, LEVEL_PARALLEL };
+
+void fireSynthetic(benchmark::State& state, Mode mode) {
+    BenchGraph fixture;
+    Graph* g = fixture.g;
+    size_t width = state.range(0), depth = state.range(1);
+    SyntheticGraph graph(g, width, depth);
+    g->setEventDriven(mode == Mode::EVENT_DRIVEN);
+    if(mode == Mode::LEVEL_PARALLEL)
+        g->setLevelParallel(state.range(2), state.range(3));
+    graph.src.fire(); //compiles the plan
+    //steady state firing must not allocate; the check only sees this thread,
+    //so it would miss the workers' share of a level-parallel fire
+    if(mode != Mode::LEVEL_PARALLEL)
+        g->setAllocationCheck(true, g->eventId());
+
+    for(auto _ : state)
+        graph.src.fire();
+
+    g->setLevelParallel(0);
+    g->setAllocationCheck(false);
+    setFiredCounters(state, width * depth);
+}
+
+void BM_FireSerial(benchmark::State& state) { fireSynthetic(state, Mode::SERIAL); }
+void BM_FireEventDriven(benchmark::State& state) { fireSynthetic(state, Mode::EVENT_DRIVEN); }
+void BM_FireLevelParallel(benchmark::State& state) { fireSynthetic(state, Mode::LEVEL_PARALLEL); }
+
+BENCHMARK(BM_FireSerial)
+    ->ArgNames({"width", "depth"})
+    ->ArgsProduct({{1, 8, 64, 512}, {1, 8, 64}});
+BENCHMARK(BM_FireEventDriven)
+    ->ArgNames({"width", "depth"})
+    ->ArgsProduct({{1, 8, 64, 512}, {1, 8, 64}});
+//A SumNode costs tens of cycles, so even a level of 512 stays under the
+//default threshold: min_cycles 0 forces every level onto the pool, and the
+//default shows the serial fallback.
+BENCHMARK(BM_FireLevelParallel)
+    ->ArgNames({"width", "depth", "threads", "min_cycles"})
+    ->ArgsProduct({{64, 512}, {8}, {1, 3}, {0, 20000}})
+    ->UseRealTime();
+
+void BM_TreeUpdated(benchmark::State& state) {
+    BenchGraph fixture;
+    SyntheticGraph graph(fixture.g, state.range(0), state.range(1));
+    for(auto _ : state)
+        graph.src.treeUpdated();
+}
+BENCHMARK(BM_TreeUpdated)
+    ->ArgNames({"width", "depth"})
+    ->ArgsProduct({{8, 64, 512}, {8, 64}});
+
+void BM_BuildSynthetic(benchmark::State& state) {
+    for(auto _ : state) {
+        state.PauseTiming();
+        auto fixture = std::make_unique<BenchGraph>();
+        state.ResumeTiming();
+        auto graph = std::make_unique<SyntheticGraph>(fixture->g, state.range(0), state.range(1));
+        benchmark::DoNotOptimize(graph->src.computeOrder_.data());
+        state.PauseTiming();
+        graph.reset(); //its nodes unregister from the graph, so before it
+        fixture.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_BuildSynthetic)
+    ->ArgNames({"width", "depth"})
+    ->ArgsProduct({{8, 64}, {8, 64}});
+
+//Graph::add of a typical per-symbol theo stack, memoization included.
+void BM_GraphAdd(benchmark::State& state) {
+    for(auto _ : state) {
+        state.PauseTiming();
+        auto fixture = std::make_unique<BenchGraph>();
+        Graph* g = fixture->g;
+        state.ResumeTiming();
+        auto md = g->add<MockEventSourceMarketData>("BENCH:SYN");
+        benchmark::DoNotOptimize(g->add<Midpt>(md));
+        benchmark::DoNotOptimize(g->add<WeightAve>(md));
+        benchmark::DoNotOptimize(g->add<FillAve>(md, 2, 0.5, 1000, 3, false));
+        benchmark::DoNotOptimize(g->add<FillAve>(md, 2, 0.5, 1000, 3, true));
+        state.PauseTiming();
+        fixture.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_GraphAdd);
+
+void BM_Deserialize(benchmark::State& state) {
+    Parameters params;
+    {
+        BenchGraph fixture;
+        auto md = fixture.g->add<MockEventSourceMarketData>("BENCH:SYN");
+        params = fixture.g->add<FillAve>(md, 2, 0.5, 1000, 3, false)->serialize();
+    }
+    for(auto _ : state) {
+        state.PauseTiming();
+        auto fixture = std::make_unique<BenchGraph>();
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(fixture->g->deserialize<Theo>(params));
+        state.PauseTiming();
+        fixture.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_Deserialize);
+
+}
@@ -0,0 +1,27 @@
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+//Runs the model benchmarks. Unless told otherwise on the command line, results
+//are also written as JSON to model_bench.json, so runs before and after an
+//engine change can be compared with google-benchmark's tools/compare.py.
+int main(int argc, char** argv) {
+    std::vector<char*> args(argv, argv + argc);
+    bool hasOut = false;
+    for(int i=1; i<argc; ++i)
+        hasOut |= std::string(argv[i]).rfind("--benchmark_out=", 0) == 0;
+    std::string out = "--benchmark_out=model_bench.json";
+    std::string format = "--benchmark_out_format=json";
+    if(not hasOut) {
+        args.push_back(&out[0]);
+        args.push_back(&format[0]);
+    }
+    int nArgs = args.size();
+    benchmark::Initialize(&nArgs, args.data());
+    if(benchmark::ReportUnrecognizedArguments(nArgs, args.data()))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,126 @@
+#include <chrono>
+
+#include <benchmark/benchmark.h>
+
+#include "model/comptheos.h"
+#include "model/market_data.h"
+#include "model/protection_adjusters.h"
+#include "model/state_nodes.h"
+#include "model/theos.h"
+#include "model/trade_signals.h"
+#include "model/test/clock_override.h"
+#include "model/test/mock_bookmsg.h"
+#include "model/test/mock_event_source_market_data.h"
+#include "model/test/utils.h"
+
+//Event throughput of representative production node stacks, driven by mock
+//market data as in the unit tests.
+
+using testing::NiceMock;
+
+namespace {
+
+//Two books with a few levels each; step() moves the top of one book and
+//fires its market data, alternating between the two.
+struct BookFixture : TestGraphMultiSym {
+    BookFixture() : TestGraphMultiSym({"BTEC:US10Y", "ESPEED:US10Y"}, {1., 1.})
+                  , btec(g->add<MockEventSourceMarketData>("BTEC:US10Y"))
+                  , espeed(g->add<MockEventSourceMarketData>("ESPEED:US10Y"))
+    {
+        btecMsg.setOutrightBook(&btecBook);
+        espeedMsg.setOutrightBook(&espeedBook);
+        for(auto book : {&btecBook, &espeedBook}) {
+            for(int i=0; i<5; ++i) {
+                book->insert(md::Order{1001 + i, Side::Bid, 100 * (i + 1), 99.0 - i});
+                book->insert(md::Order{2001 + i, Side::Ask, 100 * (i + 1), 100.0 + i});
+            }
+        }
+    }
+
+    void step(bool withTrade = false) {
+        bool first = (nEvents_ & 1) == 0;
+        auto& book = first ? btecBook : espeedBook;
+        auto& msg = first ? btecMsg : espeedMsg;
+        //alternately add and remove size at the best bid, moving the weighted mid
+        if(nEvents_ & 2)
+            book.cancel(3001);
+        else
+            book.insert(md::Order{3001, Side::Bid, 50, 99.0});
+        msg.clearTrades();
+        if(withTrade)
+            msg.addTrade(MockBookTradeMsg{5, (nEvents_ & 4) ? 100 : 99});
+        clock.incrementTime(millis{1});
+        (first ? btec : espeed)->fireBookChange(msg);
+        ++nEvents_;
+    }
+
+    NiceMock<MockBookFiniteDepthMsg> btecMsg, espeedMsg;
+    md::Book btecBook, espeedBook;
+    MockEventSourceMarketData *btec, *espeed;
+    clock_override clock;
+    uint64_t nEvents_{0};
+};
+
+template <typename Build>
+void runStack(benchmark::State& state, Build build, bool withTrades = false) {
+    BookFixture fixture;
+    auto node = build(fixture);
+    for(int i=0; i<8; ++i) //warm up emas and plans
+        fixture.step(withTrades);
+    for(auto _ : state) {
+        fixture.step(withTrades);
+        benchmark::DoNotOptimize(node->heldValue());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void BM_FillAve(benchmark::State& state) {
+    runStack(state, [](BookFixture& f) {
+        return f.g->add<FillAve>(f.btec, 2, 0.5, 1000, 3, false);
+    });
+}
+BENCHMARK(BM_FillAve);
+
+void BM_TickCompTheo(benchmark::State& state) {
+    runStack(state, [](BookFixture& f) {
+        auto base = f.g->add<WeightAve>(f.btec);
+        auto ref = f.g->add<WeightAve>(f.espeed);
+        return f.g->add<TickCompTheo>(base, ref, 10.0, 1.0);
+    });
+}
+BENCHMARK(BM_TickCompTheo);
+
+void BM_TreeSV(benchmark::State& state) {
+    runStack(state, [](BookFixture& f) {
+        auto base = f.g->add<Midpt>(f.btec);
+        std::vector<ValueNode*> features{f.g->add<WeightAve>(f.btec)};
+        //one split, two leaves (indices 1 and 2) of two sigmoids each
+        return f.g->add<TreeSV>(base, features,
+                                std::vector<double>{99.5},
+                                std::vector<int>{-1},
+                                std::vector<int>{-2},
+                                std::vector<std::vector<int>>{{}, {5, 50}, {10, 100}},
+                                std::vector<std::vector<double>>{{}, {0.1, 0.2}, {0.3, 0.4}},
+                                std::vector<double>{0, 0.9, 0.8});
+    }, true);
+}
+BENCHMARK(BM_TreeSV);
+
+void BM_HYTimeCov(benchmark::State& state) {
+    runStack(state, [](BookFixture& f) {
+        auto sig1 = f.g->add<Midpt>(f.btec);
+        auto sig2 = f.g->add<Midpt>(f.espeed);
+        auto decay = f.g->add<OnBBOT>(f.btec);
+        return f.g->add<HYTimeCov>(sig1, sig2, std::chrono::nanoseconds(std::chrono::seconds(60)), decay);
+    });
+}
+BENCHMARK(BM_HYTimeCov);
+
+void BM_LowLiquidity(benchmark::State& state) {
+    runStack(state, [](BookFixture& f) {
+        return f.g->add<LowLiquidity>(std::string("BTEC:US10Y"), 3, false, 0.5, 1000);
+    });
+}
+BENCHMARK(BM_LowLiquidity);
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "model/graph.h"
+#include "model/test/mock_node.h"
+
+//Shared helpers for the model benchmarks.
+
+//Synthetic graph of `depth` levels of `width` nodes, all clocked by one
+//source. Node i of a level takes nodes i and i+1 of the previous level as
+//parents, so every node computes on every event.
+struct SumNode : ValueNode {
+    SumNode(Graph* g, std::vector<ValueNode*> const& parents, ClockNode* clock)
+        : ValueNode(g), inputs_(parents) {
+        value_ = 0;
+        for(auto p : inputs_)
+            setParent(p);
+        setClock(clock);
+    }
+
+    void compute() override {
+        Value sum = 1;
+        for(auto p : inputs_)
+            sum += p->heldValue();
+        value_ = sum * 0.5;
+        status_ = StatusCode::OK;
+    }
+
+    std::vector<ValueNode*> inputs_;
+};
+
+struct SyntheticGraph {
+    SyntheticGraph(Graph* g, size_t width, size_t depth) : src(g, "BENCH:SYN") {
+        Graph::BuildTransaction transaction(g);
+        std::vector<ValueNode*> level;
+        for(size_t i=0; i<width; ++i) {
+            nodes.emplace_back(new SumNode(g, {}, &src));
+            level.push_back(nodes.back().get());
+        }
+        for(size_t d=1; d<depth; ++d) {
+            std::vector<ValueNode*> next;
+            for(size_t i=0; i<width; ++i) {
+                nodes.emplace_back(new SumNode(g, {level[i], level[(i+1) % width]}, &src));
+                next.push_back(nodes.back().get());
+            }
+            level.swap(next);
+        }
+    }
+
+    MockSourceNode src;
+    std::vector<std::unique_ptr<SumNode>> nodes;
+};
+
+inline void setFiredCounters(benchmark::State& state, size_t nodesPerEvent) {
+    state.SetItemsProcessed(state.iterations());
+    state.counters["nodes/s"] = benchmark::Counter(
+        double(state.iterations()) * nodesPerEvent, benchmark::Counter::kIsRate);
+}
@@ -0,0 +1,79 @@
+#include "model/book_levels.h"
+
+#include <cmath>
+#include <limits>
+
+NODE_FACTORY_ADD(BookLevels);
+
+void BookLevels::Side::resize(size_t depth) {
+    price.assign(depth, 0);
+    size.assign(depth, 0);
+    count.assign(depth, 0);
+    key.assign(depth, std::numeric_limits<double>::lowest());
+    cum_size.assign(depth + 1, 0);
+    cum_count.assign(depth + 1, 0);
+    cum_size_notional.assign(depth + 1, 0);
+    cum_count_notional.assign(depth + 1, 0);
+}
+
+void BookLevels::compute() {
+    size_t depth = market_data_->depth();
+    ask_.update(market_data_->askPricesPtr(), market_data_->askSizesPtr(),
+                market_data_->askNumOrdersPtr(), depth, true);
+    bid_.update(market_data_->bidPricesPtr(), market_data_->bidSizesPtr(),
+                market_data_->bidNumOrdersPtr(), depth, false);
+    ticked_ = true;
+    status_ = StatusCode::OK;
+}
+
+//levels [0, levelsWithin) are at or inside the stop price
+size_t BookLevels::levelsWithin(bool is_ask, double stop_price) const {
+    auto const& s = is_ask ? ask_ : bid_;
+    double tick_size = market_data_->tickSize();
+    double stop_key = is_ask ? stop_price + tick_size/2. : -(stop_price - tick_size/2.);
+    return std::upper_bound(s.key.begin(), s.key.end(), stop_key) - s.key.begin();
+}
+
+double BookLevels::priceToFill(bool is_ask, bool use_counts, double size_to_fill, double stop_price) const {
+    auto const& s = is_ask ? ask_ : bid_;
+    auto const& cum = use_counts ? s.cum_count : s.cum_size;
+    auto const& notional = use_counts ? s.cum_count_notional : s.cum_size_notional;
+
+    double left_to_trade = std::trunc(size_to_fill);
+    if ( left_to_trade <= 0 )
+        return 0;
+
+    size_t within = levelsWithin(is_ask, stop_price);
+
+    if ( cum[within] < left_to_trade )
+        return notional[within] + stop_price * (left_to_trade - cum[within]);
+
+    //the first level at which the cumulative size reaches left_to_trade
+    size_t last = std::lower_bound(cum.begin() + 1, cum.begin() + within + 1, left_to_trade) - (cum.begin() + 1);
+    return notional[last] + (left_to_trade - cum[last]) * s.price[last];
+}
+
+void BookLevels::priceToFill(bool is_ask, bool use_counts, double const* sizes_to_fill, double* notionals,
+                             size_t n, double stop_price) const {
+    auto const& s = is_ask ? ask_ : bid_;
+    auto const& amount = use_counts ? s.count : s.size;
+    auto const& cum = use_counts ? s.cum_count : s.cum_size;
+    size_t within = levelsWithin(is_ask, stop_price);
+
+    for ( size_t k=0; k<n; ++k )
+        notionals[k] = 0;
+    //Each level fills min(max(left - cum, 0), amount) of every size. Levels a
+    //size doesn't reach add exactly zero, so the sums match the serial walk.
+    for ( size_t i=0; i<within; ++i ) {
+        double filled_before = cum[i];
+        double amount_here = amount[i];
+        double price = s.price[i];
+        for ( size_t k=0; k<n; ++k ) {
+            double left = sizes_to_fill[k] - filled_before;
+            notionals[k] += std::min(std::max(left, 0.0), amount_here) * price;
+        }
+    }
+    double filled = cum[within];
+    for ( size_t k=0; k<n; ++k )
+        notionals[k] += stop_price * std::max(sizes_to_fill[k] - filled, 0.0);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "model/graph.h"
+#include "model/market_data.h"
+#include "model/serialize.h"
+
+//Prefix sums over the depth of one MarketData's book, shared by every node
+//that needs cumulative size or the cost of filling through the book.
+//
+//Each side keeps, by level, the cumulative size, count, and size and count
+//notionals, so sizeToLevel() is a lookup and priceToFill() is two binary
+//searches. On every tick each side is compared against what was cached, and
+//sums are only recomputed from the first level that changed; most updates
+//only touch one side, and the other is skipped entirely.
+//
+//Levels follow the MarketData arrays. Zero-price levels are holes: they
+//contribute nothing, just as priceToFillImpl skipped them.
+struct BookLevels : public ClockNode {
+    void compute() override;
+
+    double sizeToLevel(bool is_ask, size_t level) const {
+        auto const& s = is_ask ? ask_ : bid_;
+        return s.cum_size[std::min(level, s.depth())];
+    }
+    double countToLevel(bool is_ask, size_t level) const {
+        auto const& s = is_ask ? ask_ : bid_;
+        return s.cum_count[std::min(level, s.depth())];
+    }
+
+    //Same result as walking the book with priceToFillImpl: the notional to
+    //fill size_to_fill (truncated to whole units) at or inside stop_price,
+    //with anything left over filled at stop_price.
+    double priceToFill(bool is_ask, bool use_counts, double size_to_fill, double stop_price) const;
+
+    //priceToFill for n sizes at once, in one pass over the levels inside the
+    //stop. Sizes must already be whole units: a trunc in the inner loop keeps
+    //it from vectorizing unless built with -fno-trapping-math. The inner loop
+    //runs across sizes and is branch-free min/max, so it vectorizes at -O3.
+    void priceToFill(bool is_ask, bool use_counts, double const* sizes_to_fill, double* notionals,
+                     size_t n, double stop_price) const;
+
+    std::string defaultName() const override {
+        return getClassName() + market_data_->getName();
+    }
+
+    SERIALIZE(BookLevels, market_data_);
+
+    MarketData* market_data_;
+
+    protected:
+    size_t levelsWithin(bool is_ask, double stop_price) const;
+
+    struct Side {
+        Side() { resize(0); }
+        size_t depth() const { return price.size(); }
+        void resize(size_t depth);
+        //returns false if nothing changed
+        template<typename Price, typename Size, typename Count>
+        bool update(Price const* prices, Size const* sizes, Count const* counts, size_t depth, bool is_ask);
+
+        std::vector<double> price; //0 for empty levels
+        std::vector<double> size, count;
+        //price, negated for bids, carried over empty levels; lowest() above the
+        //first non-empty level, so it's sorted for levelsWithin
+        std::vector<double> key;
+        //by level, plus one: [i] sums levels [0, i)
+        std::vector<double> cum_size, cum_count;
+        std::vector<double> cum_size_notional, cum_count_notional;
+    };
+
+    Side bid_, ask_;
+
+    BookLevels(Graph* g, MarketData* market_data)
+        : ClockNode(g),
+          market_data_(market_data) {
+        setClock(market_data);
+    }
+};
+
+template<typename Price, typename Size, typename Count>
+bool BookLevels::Side::update(Price const* prices, Size const* sizes, Count const* counts,
+                              size_t depth, bool is_ask) {
+    if ( depth != this->depth() )
+        resize(depth);
+
+    size_t first = 0;
+    while ( first < depth ) {
+        double p = prices[first].isZero() ? 0 : prices[first].toDouble();
+        if ( p != price[first] or (p != 0 and (sizes[first] != size[first] or counts[first] != count[first])) )
+            break;
+        ++first;
+    }
+    if ( first == depth )
+        return false;
+
+    double last_key = first > 0 ? key[first-1] : std::numeric_limits<double>::lowest();
+    for ( size_t i=first; i<depth; ++i ) {
+        if ( prices[i].isZero() ) {
+            price[i] = size[i] = count[i] = 0;
+        } else {
+            price[i] = prices[i].toDouble();
+            size[i] = sizes[i];
+            count[i] = counts[i];
+            last_key = is_ask ? price[i] : -price[i];
+        }
+        key[i] = last_key;
+        cum_size[i+1] = cum_size[i] + size[i];
+        cum_count[i+1] = cum_count[i] + count[i];
+        cum_size_notional[i+1] = cum_size_notional[i] + size[i] * price[i];
+        cum_count_notional[i+1] = cum_count_notional[i] + count[i] * price[i];
+    }
+    return true;
+}
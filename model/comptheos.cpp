@@ -1,5 +1,6 @@
 #include "comptheos.h"
 
+NODE_FACTORY_ADD(CompTheoBank);
 NODE_FACTORY_ADD(TimeCompTheo);
 NODE_FACTORY_ADD(TickCompTheo);
 NODE_FACTORY_ADD(TickVWAPCompTheo);
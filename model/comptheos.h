@@ -1,8 +1,12 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <chrono>
+#include <vector>
 
 #include "clocks.h"
+#include "decay.h"
+#include "decayed_sum_bank.h"
 #include "ema.h"
 #include "graph.h"
 #include "market_data.h"
@@ -13,13 +17,79 @@
 
 using seconds = std::chrono::seconds;
 
+//Reference multipliers (ref_theo / ref_avg)^vol_mult for every comp theo
+//that compares against one ref average, computed together.
+//
+//Comp theos ask for a slot with addComp(vol_mult), and g->add memoizes on
+//(ref_theo, ref_avg, clock), so every vol mult compared against the same
+//average shares a bank, whatever kind of comp theo asked. When the ref theo
+//or the average ticks, the log of the ratio is taken once and the
+//multipliers are exp(vol_mult * log), in one loop over the contiguous vol
+//mults, instead of a pow per comp theo. The loop uses Decay::expSigned, so
+//it vectorizes.
+//
+//The bank is keyed by average, not just by ref theo, so that its parents are
+//exactly the comp theos' own: a ref VWAP that hasn't traded yet leaves only
+//the comp theos on that VWAP invalid, not the EMA ones on the same ref.
+//
+//clock must cover the ref theo and the average. The comp theos keep their
+//own clocks and read the bank as a parent.
+struct CompTheoBank : public ValueNode {
+    void compute() override {
+        double log_ratio = std::log(ref_theo_->heldValue() / ref_avg_->heldValue());
+        size_t n = vol_mult_.size();
+        double const* vol_mult = vol_mult_.data();
+        double* mult = mult_.data();
+        for ( size_t i=0; i<n; ++i )
+            mult[i] = Decay::expSigned(vol_mult[i] * log_ratio);
+        value_ = n ? mult_[0] : 1.0;
+        status_ = StatusCode::OK;
+    }
+
+    //Returns the slot for this vol mult, adding it if it's new. A slot added
+    //after the bank has started firing starts at 1, as a comp theo's own
+    //multiplier did, until the ref side next ticks.
+    size_t addComp(double vol_mult) {
+        auto it = std::find(vol_mult_.begin(), vol_mult_.end(), vol_mult);
+        size_t slot = it - vol_mult_.begin();
+        if ( it == vol_mult_.end() ) {
+            vol_mult_.push_back(vol_mult);
+            mult_.push_back(1.0);
+        }
+        return slot;
+    }
+
+    double mult(size_t slot) const { return mult_[slot]; }
+
+    std::string defaultName() const override {
+        return getClassName() + ref_theo_->getName() + ref_avg_->getName();
+    }
+
+    SERIALIZE(CompTheoBank, ref_theo_, ref_avg_, clock_);
+
+    Theo* ref_theo_;
+    ValueNode* ref_avg_;
+    ClockNode* clock_;
+
+    protected:
+    std::vector<double> vol_mult_; //by slot
+    std::vector<double> mult_;     //by slot
+
+    CompTheoBank(Graph* g, Theo* ref_theo, ValueNode* ref_avg, ClockNode* clock)
+        : ValueNode(g, Units::NONE),
+          ref_theo_(ref_theo),
+          ref_avg_(ref_avg),
+          clock_(clock) {
+        value_ = 1.0;
+        setParents(ref_theo, ref_avg);
+        setClock(clock, ref_theo);
+    }
+};
+
 // Basic theoretical price signal implementations.
 struct TimeCompTheo : public Theo {
     void compute() override {
-        if ( ref_theo_->ticked() or ref_ema_->ticked() ) {
-            auto ref_ratio = ref_theo_->heldValue() / ref_ema_->heldValue();
-            ref_mult_ = std::pow(ref_ratio, vol_mult_);
-        }
+        ref_mult_ = bank_->mult(slot_);
         value_ = base_ema_->heldValue() * ref_mult_;
         status_ = StatusCode::OK;
     }
@@ -39,6 +109,8 @@ struct TimeCompTheo : public Theo {
     std::chrono::nanoseconds ema_length_;
     double vol_mult_;
     double ref_mult_{1.0};
+    CompTheoBank* bank_;
+    size_t slot_;
 
     TimeCompTheo(Graph* g, Theo* base_theo, Theo* ref_theo, 
                   std::chrono::nanoseconds ema_length, double vol_mult)
@@ -50,8 +122,10 @@ struct TimeCompTheo : public Theo {
 
         base_ema_ = g->add<TimeEMA>(base_theo, base_theo->marketData(), ema_length);
         ref_ema_ = g->add<TimeEMA>(ref_theo, ref_theo->marketData(), ema_length);
+        bank_ = g->add<CompTheoBank>(ref_theo, ref_ema_, ref_theo->marketData());
+        slot_ = bank_->addComp(vol_mult_);
 
-        setParents(base_ema_, ref_ema_, ref_theo_);
+        setParents(base_ema_, ref_ema_, ref_theo_, bank_);
         setClock(base_ema_, ref_ema_, ref_theo_);
     }
 };
@@ -59,10 +133,7 @@ struct TimeCompTheo : public Theo {
 //theo emas decay on a join of both theo clocks by fixed amount 
 struct TickCompTheo : public Theo {
     void compute() override {
-        if ( ref_theo_->ticked() or ref_ema_->ticked() ) {
-            auto ref_ratio = ref_theo_->heldValue() / ref_ema_->heldValue();
-            ref_mult_ = std::pow(ref_ratio, vol_mult_);
-        }
+        ref_mult_ = bank_->mult(slot_);
         value_ = base_ema_->heldValue() * ref_mult_;
         status_ = StatusCode::OK;
     }
@@ -82,6 +153,8 @@ struct TickCompTheo : public Theo {
     double ema_length_;
     double vol_mult_;
     double ref_mult_{1.0};
+    CompTheoBank* bank_;
+    size_t slot_;
 
     TickCompTheo(Graph* g, Theo* base_theo, Theo* ref_theo, 
                   double ema_length, double vol_mult)
@@ -94,8 +167,10 @@ struct TickCompTheo : public Theo {
         auto joint_clock = joinClocks(base_theo, ref_theo);
         base_ema_ = g->add<TickEMA>(base_theo, joint_clock, ema_length);
         ref_ema_ = g->add<TickEMA>(ref_theo, joint_clock, ema_length);
+        bank_ = g->add<CompTheoBank>(ref_theo, ref_ema_, joint_clock);
+        slot_ = bank_->addComp(vol_mult_);
 
-        setParents(base_ema_, ref_ema_, ref_theo_);
+        setParents(base_ema_, ref_ema_, ref_theo_, bank_);
         setClock(joint_clock);
     }
 };
@@ -103,10 +178,7 @@ struct TickCompTheo : public Theo {
 
 struct TimeVWAPCompTheo : public Theo {
     void compute() override {
-        if ( ref_theo_->ticked() or ref_vwap_->ticked() ) {
-            auto ref_ratio = ref_theo_->heldValue() / ref_vwap_->heldValue();
-            ref_mult_ = std::pow(ref_ratio, vol_mult_);
-        }
+        ref_mult_ = bank_->mult(slot_);
         value_ = base_vwap_->heldValue() * ref_mult_;
         status_ = StatusCode::OK;
     }
@@ -125,6 +197,8 @@ struct TimeVWAPCompTheo : public Theo {
     std::chrono::nanoseconds nano_vwap_length_;
     double vol_mult_;
     double ref_mult_{1.0};
+    CompTheoBank* bank_;
+    size_t slot_;
 
     protected:
     TimeVWAPCompTheo(Graph* g, MarketData* base_market_data, Theo* ref_theo, 
@@ -138,8 +212,10 @@ struct TimeVWAPCompTheo : public Theo {
         auto on_ref_trades = g->add<OnTrade>(ref_theo->marketData());
         base_vwap_ = g->add<TimeVWAP>(base_market_data, nano_vwap_length);
         ref_vwap_ = g->add<TimeVWAP>(ref_theo->marketData(), nano_vwap_length);
+        bank_ = g->add<CompTheoBank>(ref_theo, ref_vwap_, ref_theo->marketData());
+        slot_ = bank_->addComp(vol_mult_);
 
-        setParents(base_vwap_, ref_vwap_, ref_theo);
+        setParents(base_vwap_, ref_vwap_, ref_theo, bank_);
         setClock(on_base_trades, on_ref_trades, ref_theo);
     }
 };
@@ -147,10 +223,7 @@ struct TimeVWAPCompTheo : public Theo {
 
 struct TickVWAPCompTheo : public Theo {
     void compute() override {
-        if ( ref_theo_->ticked() or ref_vwap_->ticked() ) {
-            auto ref_ratio = ref_theo_->heldValue() / ref_vwap_->heldValue();
-            ref_mult_ = std::pow(ref_ratio, vol_mult_);
-        }
+        ref_mult_ = bank_->mult(slot_);
         value_ = base_vwap_->heldValue() * ref_mult_;
         status_ = StatusCode::OK;
     }
@@ -169,6 +242,8 @@ struct TickVWAPCompTheo : public Theo {
     double tick_vwap_length_;
     double vol_mult_;
     double ref_mult_{1.0};
+    CompTheoBank* bank_;
+    size_t slot_;
 
     protected:
     TickVWAPCompTheo(Graph* g, MarketData* base_market_data, Theo* ref_theo, 
@@ -182,8 +257,10 @@ struct TickVWAPCompTheo : public Theo {
         auto on_ref_trades = g->add<OnTrade>(ref_theo->marketData());
         base_vwap_ = g->add<TickVWAP>(base_market_data, on_base_trades, tick_vwap_length);
         ref_vwap_ = g->add<TickVWAP>(ref_theo->marketData(), on_ref_trades, tick_vwap_length);
+        bank_ = g->add<CompTheoBank>(ref_theo, ref_vwap_, on_ref_trades);
+        slot_ = bank_->addComp(vol_mult_);
 
-        setParents(base_vwap_, ref_vwap_, ref_theo);
+        setParents(base_vwap_, ref_vwap_, ref_theo, bank_);
         setClock(on_base_trades, on_ref_trades, ref_theo);
     }
 };
@@ -217,10 +294,10 @@ struct RefTradeIntensity : public ValueNode {
     MarketData* ref_md_;
     std::chrono::nanoseconds long_decay_; 
     std::chrono::nanoseconds short_decay_;
-    TimeDecayedSum* base_long_sum_;
-    TimeDecayedSum* base_short_sum_;
-    TimeDecayedSum* ref_long_sum_;
-    TimeDecayedSum* ref_short_sum_;
+    DecayedSum* base_long_sum_;
+    DecayedSum* base_short_sum_;
+    DecayedSum* ref_long_sum_;
+    DecayedSum* ref_short_sum_;
     double base_intensity_{0}, ref_intensity_{0};
 
     protected:
@@ -242,17 +319,15 @@ struct RefTradeIntensity : public ValueNode {
         auto base_trade_size = g->add<TradeSize>(base_md);
         auto padded_base_trades = g->add<Pad>(base_trade_size, joint_clock, 0);
 
-        base_long_sum_ = g->add<TimeDecayedSum>(padded_base_trades, 
-                joint_clock, long_decay);
-        base_short_sum_ = g->add<TimeDecayedSum>(padded_base_trades, 
-                joint_clock, short_decay);
+        auto base_sums = g->add<DecayedSumBank>(padded_base_trades, joint_clock);
+        base_long_sum_ = g->add<DecayedSum>(base_sums, long_decay);
+        base_short_sum_ = g->add<DecayedSum>(base_sums, short_decay);
 
         auto ref_trade_size = g->add<TradeSize>(ref_md);
         auto padded_ref_trades = g->add<Pad>(ref_trade_size, joint_clock, 0);
-        ref_long_sum_ = g->add<TimeDecayedSum>(padded_ref_trades, joint_clock, 
-                long_decay);
-        ref_short_sum_ = g->add<TimeDecayedSum>(padded_ref_trades, joint_clock, 
-                short_decay);
+        auto ref_sums = g->add<DecayedSumBank>(padded_ref_trades, joint_clock);
+        ref_long_sum_ = g->add<DecayedSum>(ref_sums, long_decay);
+        ref_short_sum_ = g->add<DecayedSum>(ref_sums, short_decay);
 
         setParents(base_long_sum_, base_short_sum_, ref_long_sum_, ref_short_sum_);
         setClock(joint_clock);
@@ -322,12 +397,8 @@ struct PredictivePacketRate : public ValueNode {
     void decayEverything() {
         auto current_uptime_ = currentUptime();
         double nanos_elapsed = current_uptime_ - last_uptime_;
-        double short_decay_factor = std::max(0.0, 1.0 - nanos_elapsed/ems_length_.count());
-        double long_decay_factor = std::max(0.0, 1.0 - nanos_elapsed/long_ems_length_);
-
-        base_long_ems_ *= long_decay_factor;
-        ref_long_ems_ *= long_decay_factor;
-        ref_short_ems_ *= short_decay_factor; 
+        long_decay_.apply(nanos_elapsed, base_long_ems_, ref_long_ems_);
+        short_decay_.apply(nanos_elapsed, ref_short_ems_);
         last_uptime_ = current_uptime_;
     }
 
@@ -351,40 +422,110 @@ struct PredictivePacketRate : public ValueNode {
     }
 
     std::string defaultName() const override { 
-        return (getClassName() + base_md_->shortSymbol() + ref_md_->shortSymbol() + getDurationString(ems_length_));
+        return (getClassName() + base_md_->shortSymbol() + ref_md_->shortSymbol() + getDurationString(ems_length_)
+              + Decay::nameSuffix(decay_kind_));
     }
 
-    SERIALIZE(PredictivePacketRate, base_md_, ref_md_, ems_length_);
+    SERIALIZE(PredictivePacketRate, base_md_, ref_md_, ems_length_, decay_kind_);
 
     MarketData* base_md_;
     MarketData* ref_md_;
     std::chrono::nanoseconds ems_length_;
+    Decay::Kind decay_kind_;
     double base_long_ems_{0}, ref_long_ems_{0} , ref_short_ems_{0};
     SimpleEMA conditional_ema_;
     int64_t last_uptime_;
     double long_ems_length_;
+    Decay short_decay_, long_decay_;
     
     PredictivePacketRate(Graph* g, MarketData* base_md,
                        MarketData* ref_md, 
-                       std::chrono::nanoseconds ems_length)
+                       std::chrono::nanoseconds ems_length,
+                       Decay::Kind decay_kind=Decay::Kind::LINEAR)
         : ValueNode(g, Units::NONE),
           base_md_(base_md),
           ref_md_(ref_md),
-          ems_length_(ems_length) {
+          ems_length_(ems_length),
+          decay_kind_(decay_kind),
+          long_ems_length_(1e9 * 60 * 30),
+          short_decay_(ems_length, decay_kind),
+          long_decay_(long_ems_length_, decay_kind) {
         conditional_ema_.setLength(5);
-        long_ems_length_ = 1e9 * 60 * 30;
         setClock(g->add<OnTrade>(base_md), ref_md);
     }
 };
 
+//The weighted mixture (base + sum w_i x_i) / (1 + sum w_i), kept as running
+//sums so one ref's weight or value can change in O(1).
+//
+//Every weight decays by the same factor, so weights are stored divided by a
+//common DecayScale and decay() only multiplies the scale. The scale is folded
+//back into the weights when it gets small, and setValues() recomputes both
+//sums from scratch, which also clears rounding from the incremental updates.
+struct DecayedMixture {
+    void resize(size_t n) {
+        weights_.assign(n, 0);
+        values_.assign(n, 0);
+        scale_.reset();
+        weight_sum_ = weighted_sum_ = 0;
+    }
+    size_t size() const { return weights_.size(); }
+
+    void decay(double factor) {
+        scale_.decay(factor,
+            [this]() {
+                std::fill(weights_.begin(), weights_.end(), 0);
+                weight_sum_ = weighted_sum_ = 0;
+            },
+            [this](double) { setValues([this](size_t i) { return values_[i]; }); });
+    }
+
+    void addWeight(size_t i, double w) {
+        double scaled = w / scale_.value();
+        weights_[i] += scaled;
+        weight_sum_ += scaled;
+        weighted_sum_ += scaled * values_[i];
+    }
+
+    void setValue(size_t i, double x) {
+        weighted_sum_ += weights_[i] * (x - values_[i]);
+        values_[i] = x;
+    }
+
+    template<typename ValueOf>
+    void setValues(ValueOf value_of) {
+        weight_sum_ = weighted_sum_ = 0;
+        for ( size_t i=0; i<weights_.size(); ++i ) {
+            weights_[i] *= scale_.value();
+            values_[i] = value_of(i);
+            weight_sum_ += weights_[i];
+            weighted_sum_ += weights_[i] * values_[i];
+        }
+        scale_.reset();
+    }
+
+    double weight(size_t i) const { return weights_[i] * scale_.value(); }
+    double weightSum() const { return weight_sum_ * scale_.value(); }
+    double weightedSum() const { return weighted_sum_ * scale_.value(); }
+
+    private:
+    std::vector<double> weights_; //by ref, divided by scale_
+    std::vector<double> values_;  //by ref
+    DecayScale scale_;
+    double weight_sum_{0}, weighted_sum_{0}; //divided by scale_
+};
+
+//Mixes TimeMaxCompTheos against each ref, weighted by the ref's recent trade
+//volume: the decayed sum that PredictivePacketRate keeps as its value, held
+//here for all refs in a DecayedMixture and decayed with one time read.
 struct PacketRateCompTheo : public Theo {
     void compute2() {
         value_ = 0;
         double max_val = 0;
-        for ( auto p : components_ ) {
-            if (max_val < p.first->heldValue()) {
-                value_ = p.second->heldValue();
-                max_val = p.first->heldValue(); 
+        for ( size_t i=0; i<comp_theos_.size(); ++i ) {
+            if (max_val < mixture_.weight(i)) {
+                value_ = comp_theos_[i]->heldValue();
+                max_val = mixture_.weight(i); 
             }
         }
         if (max_val==0) {
@@ -396,15 +537,29 @@ struct PacketRateCompTheo : public Theo {
         status_ = StatusCode::OK;
     }
 
+    void updateMixture() {
+        int64_t current_uptime = getGraph()->nSecUptime();
+        auto comp_value = [this](size_t i) { return comp_theos_[i]->heldValue(); };
+        if ( unlikely(status_==StatusCode::INIT) ) {
+            mixture_.setValues(comp_value);
+        } else {
+            mixture_.decay(short_decay_.factor(current_uptime - last_uptime_));
+            //a comp theo can tick on events this node doesn't fire on, so
+            //every value is re-read; only the weights follow the refs' trades
+            for ( size_t i=0; i<ref_mds_.size(); ++i ) {
+                mixture_.setValue(i, comp_value(i));
+                if ( ref_mds_[i]->ticked() )
+                    mixture_.addWeight(i, ref_mds_[i]->tradeSize());
+            }
+        }
+        last_uptime_ = current_uptime;
+    }
+
      void compute() override {
+        updateMixture();
         //Initialize this way to regularize when other weights are small.
-        double sum = 1;
-        value_ = base_theo_->heldValue();
-        for ( auto p : components_ ) {
-            double wgt = p.first->heldValue();
-            sum += wgt;
-            value_ += wgt * p.second->heldValue(); 
-        }
+        double sum = 1 + mixture_.weightSum();
+        value_ = base_theo_->heldValue() + mixture_.weightedSum();
         //Should we include the base theo in the weighting computation?  Then the sum will always be positive...
         if ( sum > 0) { //Test reverting to base_theo when weights have decayed a bit.
             value_ /= sum;
@@ -425,29 +580,28 @@ struct PacketRateCompTheo : public Theo {
     MarketData* base_md_;
     std::vector<MarketData*> ref_mds_;
     std::chrono::nanoseconds ems_length_, ct_length_;
-    std::vector<std::pair<ValueNode*, TimeMaxCompTheo*>> components_;
+    std::vector<TimeMaxCompTheo*> comp_theos_; //by ref
     Theo* base_theo_;
+    DecayedMixture mixture_;
+    Decay short_decay_;
+    int64_t last_uptime_{0};
     
     PacketRateCompTheo(Graph* g, MarketData* base_md, std::vector<MarketData*> ref_mds, std::chrono::nanoseconds ems_length, std::chrono::nanoseconds ct_length)
         : Theo(g, base_md->symbol()),
           base_md_(base_md),
           ref_mds_(ref_mds),
           ems_length_(ems_length),
-          ct_length_(ct_length) {
+          ct_length_(ct_length),
+          short_decay_(ems_length) {
         
-        std::vector<ValueNode*> parents;
         base_theo_ = g->add<FillAve>(base_md, 2, 0.5, 100000,  4, false);
         for (auto ref_md : ref_mds ) {
-            std::pair<ValueNode*, TimeMaxCompTheo*> p;
             Theo* ref_theo = g->add<FillAve>(ref_md, 2, 0.5, 100000,  4, false);
             double vol_mult = getVolMult(base_theo_->symbol(), ref_theo->symbol());
-            p.first = g->add<PredictivePacketRate>(base_md, ref_md, ems_length_);
-            p.second = g->add<TimeMaxCompTheo>(base_theo_, ref_theo, ct_length, vol_mult);
-            components_.push_back(p);
-            parents.push_back(p.first);
-            parents.push_back(p.second);
+            comp_theos_.push_back(g->add<TimeMaxCompTheo>(base_theo_, ref_theo, ct_length, vol_mult));
         }
-        setParents(parents);
+        mixture_.resize(ref_mds.size());
+        setParents(base_theo_, comp_theos_);
         setClock(base_md, ref_mds);
     }
 };
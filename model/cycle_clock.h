@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//Cheap timestamp for measuring short stretches of work in cycles. It's only
+//meant for differences taken on the same core, e.g. the cost of one node's
+//fire(), and is not converted to wall time.
+inline uint64_t readCycles() {
+    #if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+    #else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    #endif
+}
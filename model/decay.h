@@ -0,0 +1,140 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+
+//Time decay shared by the decayed accumulators in the state nodes.
+//
+//A Decay is built once per length, keeping the reciprocal, so computing a
+//factor is a multiply rather than a division. LINEAR is the 1 - dt/L
+//approximation, clipped at zero, that these nodes have always used. EXP is
+//the exact exp(-dt/L), computed with expNeg() below.
+//
+//Nodes that decay take the kind as their last, serialized, constructor
+//argument, defaulting to LINEAR (EXP for DecayedCovMatrix), and add
+//nameSuffix() to their default name.
+//
+//apply() decays any number of accumulators that share the length by the same
+//factor, so the factor is only computed once per event.
+struct Decay {
+    enum class Kind : uint8_t { LINEAR, EXP };
+
+    explicit Decay(std::chrono::nanoseconds length, Kind kind=Kind::LINEAR)
+        : invLength_(1.0 / length.count()), kind_(kind)
+    {}
+    explicit Decay(double lengthNanos, Kind kind=Kind::LINEAR)
+        : invLength_(1.0 / lengthNanos), kind_(kind)
+    {}
+
+    Kind kind() const { return kind_; }
+    void setKind(Kind kind) { kind_ = kind; }
+
+    //Empty for LINEAR, so existing node names don't change.
+    static std::string nameSuffix(Kind kind) { return kind == Kind::EXP ? "Exp" : ""; }
+
+    double factor(double elapsedNanos) const {
+        double x = elapsedNanos * invLength_;
+        if(kind_ == Kind::LINEAR)
+            return x < 1.0 ? 1.0 - x : 0.0;
+        return expNeg(x);
+    }
+
+    template<typename... T>
+    double apply(double elapsedNanos, T&... accumulators) const {
+        double f = factor(elapsedNanos);
+        (void)std::initializer_list<int>{ (accumulators *= f, 0)... };
+        return f;
+    }
+
+    double apply(double elapsedNanos, double* accumulators, size_t n) const {
+        double f = factor(elapsedNanos);
+        for(size_t i=0; i<n; ++i)
+            accumulators[i] *= f;
+        return f;
+    }
+
+    //exp(-x) for x >= 0, to about 2e-7 relative, with no call into libm.
+    //exp(-x) = 2^-k * 2^-r, with k the nearest integer to x*log2(e) and r in
+    //[-0.5, 0.5]; 2^-r comes from its Taylor series and 2^-k goes straight
+    //into the exponent bits.
+    static double expNeg(double x) {
+        constexpr double log2e = 1.4426950408889634;
+        double y = x * log2e;
+        if(not (y < 1022.0))
+            return 0.0; //also catches NaN
+        if(y < 0.0)
+            y = 0.0;
+        int64_t k = static_cast<int64_t>(y + 0.5);
+        double r = y - k;
+        double p = 1.0 + r * (-0.6931471805599453 + r * (0.2402265069591007
+                 + r * (-0.0555041086648216 + r * (0.0096181291076285
+                 + r * (-0.0013333558146428 + r * 0.0001540353039338)))));
+        uint64_t bits = static_cast<uint64_t>(1023 - k) << 52;
+        double scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+    //exp(x) for finite x, to about 1e-14 relative (1 ulp near zero), saturating
+    //at 2^-1022 and 2^1023, with no call into libm. The same reduction as
+    //expNeg, with the Taylor series of 2^r taken further; it's branch-free,
+    //the clamp done with 0/1 weights and k rounded by adding 1.5 * 2^52, so
+    //a loop over it vectorizes, which one over std::exp doesn't.
+    static double expSigned(double x) {
+        constexpr double log2e = 1.4426950408889634;
+        constexpr double ln2 = 0.6931471805599453;
+        constexpr double round = 6755399441055744.0; //1.5 * 2^52
+        double y = x * log2e;
+        double low = y < -1022.0, high = y > 1023.0;
+        y = low * -1022.0 + high * 1023.0 + (1.0 - low - high) * y;
+        double t = y + round; //k in the low mantissa bits
+        double k = t - round;
+        double r = (y - k) * ln2;
+        double p = 1.0 + r * (1.0 + r * (1.0/2 + r * (1.0/6 + r * (1.0/24 + r * (1.0/120
+                 + r * (1.0/720 + r * (1.0/5040 + r * (1.0/40320 + r * (1.0/362880
+                 + r * (1.0/3628800 + r * (1.0/39916800)))))))))));
+        uint64_t bits;
+        std::memcpy(&bits, &t, sizeof(bits));
+        bits = (bits + 1023) << 52;
+        double scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+        return p * scale;
+    }
+
+    private:
+    double invLength_;
+    Kind kind_;
+};
+
+//A common scale for values that all decay by the same factor, so they can
+//be stored divided by it and a decay is a single multiply.
+//
+//decay() multiplies the scale by the factor. On a full decay it calls
+//clear() to zero the stored values; once the scale drops below 1e-100 it
+//calls fold(scale) to multiply it into them, long before it underflows.
+//Either way the scale is back to 1 afterwards.
+struct DecayScale {
+    double value() const { return scale_; }
+    void reset() { scale_ = 1; }
+
+    template<typename Clear, typename Fold>
+    void decay(double factor, Clear clear, Fold fold) {
+        if(factor <= 0) {
+            clear();
+            scale_ = 1;
+            return;
+        }
+        scale_ *= factor;
+        if(scale_ < 1e-100) {
+            fold(scale_);
+            scale_ = 1;
+        }
+    }
+
+    private:
+    double scale_{1};
+};
@@ -0,0 +1,221 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+#include "decay.h"
+#include "graph.h"
+#include "serialize.h"
+
+//Time-decayed Hayashi-Yoshida covariances between every pair of a set of
+//asynchronous signals, kept in one node.
+//
+//Each off-diagonal entry follows HYTimeCov exactly: a signal's move is
+//measured from its lag, and the product of the two moves is added, and the
+//lag reset, only when the pair alternates. The diagonal is the decayed
+//quadratic variation, as QuadraticVariation keeps it. Entries and
+//correlations are read through DecayedCov and DecayedCorr views:
+//
+//    auto cov = g->add<DecayedCovMatrix>(mids, length, decay_clock);
+//    auto corr_2y_10y = g->add<DecayedCorr>(cov, mid_2y, mid_10y);
+//
+//When a signal ticks only its row changes, so an event is O(N) rather than
+//the O(N^2) of one HYTimeCov per pair. The matrix is stored square, so that
+//row is contiguous and the update loop vectorizes; the column is mirrored
+//after. All entries decay by the same factor, so they're stored divided by
+//a common DecayScale, and decaying the matrix is a single multiply.
+//
+//The decay kind is the last, serialized, constructor argument. Unlike the
+//other decayed nodes it defaults to EXP, which composes exactly however
+//often the matrix fires; with LINEAR, entries decay on every event of the
+//union clock rather than on each pair's own, and differ from HYTimeCov's.
+struct DecayedCovMatrix : public ValueNode {
+    void compute() override {
+        int64_t current_time = getGraph()->nSecUptime();
+        if ( unlikely(status_==StatusCode::INIT) ) {
+            for ( size_t i=0; i<n_; ++i )
+                std::fill(&lag_[i*n_], &lag_[i*n_] + n_, signals_[i]->heldValue());
+            last_decay_time_ = current_time;
+        } else {
+            double elapsed_nanos = current_time - last_decay_time_;
+            if ( elapsed_nanos < 1 ) elapsed_nanos = 1;
+            decayAll(decay_.factor(elapsed_nanos));
+            last_decay_time_ = current_time;
+            for ( size_t i=0; i<n_; ++i )
+                if ( signals_[i]->ticked() )
+                    updateRow(i, signals_[i]->value());
+        }
+        value_ = 0;
+        for ( size_t i=0; i<n_; ++i )
+            value_ += cov_[i*n_+i];
+        value_ *= scale_.value();
+        status_ = StatusCode::OK;
+    }
+
+    size_t size() const { return n_; }
+    double cov(size_t i, size_t j) const { return cov_[i*n_+j] * scale_.value(); }
+    double corr(size_t i, size_t j) const {
+        double var = cov_[i*n_+i] * cov_[j*n_+j];
+        return var > 0 ? cov_[i*n_+j] / std::sqrt(var) : 0;
+    }
+
+    //Throws std::invalid_argument if sig isn't one of the signals.
+    size_t indexOf(ValueNode* sig) const {
+        auto it = std::find(signals_.begin(), signals_.end(), sig);
+        if ( it == signals_.end() )
+            throw std::invalid_argument(getClassName() + "::indexOf : " + sig->getName() + " is not in the matrix");
+        return it - signals_.begin();
+    }
+
+    std::string defaultName() const override {
+        std::string name = getClassName();
+        for ( auto sig : signals_ )
+            name += sig->getName();
+        return name + getDurationString(length_in_nanos_) + Decay::nameSuffix(decay_kind_);
+    }
+
+    SERIALIZE(DecayedCovMatrix, signals_, length_in_nanos_, decay_clock_, decay_kind_);
+
+    std::vector<ValueNode*> signals_;
+    std::chrono::nanoseconds length_in_nanos_;
+    ClockNode* decay_clock_;
+    Decay::Kind decay_kind_;
+
+    protected:
+    //Row i's move against each j: products are added, and lags reset, only
+    //where j ticked more recently than i. Done branch-free, with was_last_
+    //as 0/1 weights. j == i is the quadratic variation: was_last_ is 0 on
+    //the diagonal, and dx_[i][i] is the move just written.
+    void updateRow(size_t i, double x) {
+        double* cov = &cov_[i*n_];
+        double* lag = &lag_[i*n_];
+        double* dx = &dx_[i*n_];
+        double* was_last = &was_last_[i*n_];
+        double inv_scale = 1.0 / scale_.value();
+        for ( size_t j=0; j<n_; ++j ) {
+            double d = x - lag[j];
+            double alternated = 1.0 - was_last[j];
+            dx[j] = d;
+            cov[j] += alternated * d * dx_[j*n_+i] * inv_scale;
+            lag[j] += alternated * d;
+            was_last[j] = 1.0;
+        }
+        for ( size_t j=0; j<n_; ++j ) {
+            cov_[j*n_+i] = cov[j];
+            was_last_[j*n_+i] = 0.0;
+        }
+    }
+
+    void decayAll(double factor) {
+        scale_.decay(factor,
+            [this]() { std::fill(cov_.begin(), cov_.end(), 0); },
+            [this](double scale) {
+                for ( auto& c : cov_ )
+                    c *= scale;
+            });
+    }
+
+    size_t n_;
+    Decay decay_;
+    int64_t last_decay_time_{0};
+    DecayScale scale_;
+    //n_ x n_, row-major. cov_ is symmetric and divided by scale_; the rest
+    //are by (i, j): signal i's lag, move and whether it ticked last in pair i,j.
+    std::vector<double> cov_, lag_, dx_, was_last_;
+
+    DecayedCovMatrix(Graph* g, std::vector<ValueNode*> signals,
+                     std::chrono::nanoseconds length_in_nanos, ClockNode* decay_clock,
+                     Decay::Kind decay_kind=Decay::Kind::EXP)
+        : ValueNode(g, Units::NONE),
+          signals_(signals),
+          length_in_nanos_(length_in_nanos),
+          decay_clock_(decay_clock),
+          decay_kind_(decay_kind),
+          n_(signals.size()),
+          decay_(length_in_nanos, decay_kind),
+          cov_(n_*n_, 0),
+          lag_(n_*n_, 0),
+          dx_(n_*n_, 0),
+          was_last_(n_*n_, 0) {
+        for ( size_t i=0; i<n_; ++i ) {
+            for ( size_t j=i+1; j<n_; ++j ) {
+                assert(!hasCommonSourceClock(signals[i], signals[j]));  //calculations assume strictly asyncronous.
+                was_last_[i*n_+j] = 1.0; //arbitrary, as in HYTimeCov
+            }
+        }
+        value_ = 0;
+        setParents(signals_);
+        setClock(signals_, decay_clock);
+    }
+};
+
+//One covariance from a DecayedCovMatrix.
+struct DecayedCov : public ValueNode {
+    void compute() override {
+        value_ = matrix_->cov(i_, j_);
+        status_ = StatusCode::OK;
+    }
+
+    bool stateless() const override { return true; }
+
+    std::string defaultName() const override {
+        return getClassName() + sig1_->getName() + sig2_->getName()
+             + getDurationString(matrix_->length_in_nanos_);
+    }
+
+    SERIALIZE(DecayedCov, matrix_, sig1_, sig2_);
+
+    DecayedCovMatrix* matrix_;
+    ValueNode *sig1_, *sig2_;
+
+    protected:
+    size_t i_, j_;
+
+    DecayedCov(Graph* g, DecayedCovMatrix* matrix, ValueNode* sig1, ValueNode* sig2)
+        : ValueNode(g, Units::NONE),
+          matrix_(matrix),
+          sig1_(sig1),
+          sig2_(sig2),
+          i_(matrix->indexOf(sig1)),
+          j_(matrix->indexOf(sig2)) {
+        setParents(matrix);
+        setClock(matrix);
+    }
+};
+
+//One correlation from a DecayedCovMatrix; 0 until both signals have moved.
+struct DecayedCorr : public ValueNode {
+    void compute() override {
+        value_ = matrix_->corr(i_, j_);
+        status_ = StatusCode::OK;
+    }
+
+    bool stateless() const override { return true; }
+
+    std::string defaultName() const override {
+        return getClassName() + sig1_->getName() + sig2_->getName()
+             + getDurationString(matrix_->length_in_nanos_);
+    }
+
+    SERIALIZE(DecayedCorr, matrix_, sig1_, sig2_);
+
+    DecayedCovMatrix* matrix_;
+    ValueNode *sig1_, *sig2_;
+
+    protected:
+    size_t i_, j_;
+
+    DecayedCorr(Graph* g, DecayedCovMatrix* matrix, ValueNode* sig1, ValueNode* sig2)
+        : ValueNode(g, Units::NONE),
+          matrix_(matrix),
+          sig1_(sig1),
+          sig2_(sig2),
+          i_(matrix->indexOf(sig1)),
+          j_(matrix->indexOf(sig2)) {
+        setParents(matrix);
+        setClock(matrix);
+    }
+};
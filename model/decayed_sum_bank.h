@@ -0,0 +1,134 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "decay.h"
+#include "graph.h"
+#include "serialize.h"
+
+//Time-decayed sums of one input at several horizons, updated together.
+//
+//Each horizon is requested through a DecayedSum view:
+//
+//    auto bank = g->add<DecayedSumBank>(padded_input, clock);
+//    auto long_sum = g->add<DecayedSum>(bank, long_decay);
+//    auto short_sum = g->add<DecayedSum>(bank, short_decay);
+//
+//g->add memoizes on (input, clock, decay kind), so every node asking for sums
+//of the same input on the same clock gets the same bank, and horizons
+//requested twice share a slot. The kind defaults to LINEAR. On each tick the bank computes all the decay factors from one
+//elapsed time and updates the sums in one pass over flat arrays, which the
+//compiler vectorizes for the default LINEAR decay. The views are lazy, so a
+//tick costs that pass and nothing per view until a sum is read; a node that
+//holds the bank can also read sum(slot) directly.
+//
+//The bank's own value is the first horizon's sum, i.e. that of the first
+//view added, so that it has a meaningful value as a ValueNode; it's not a
+//combination of the horizons.
+struct DecayedSumBank : public ValueNode {
+    void compute() override {
+        int64_t current_time = getGraph()->nSecUptime();
+        if ( unlikely(status_==StatusCode::INIT) ) {
+            last_decay_time_ = current_time;
+        } else {
+            double elapsed_nanos = current_time - last_decay_time_;
+            last_decay_time_ = current_time;
+            decayAll(elapsed_nanos);
+        }
+        double x = input_->value();
+        for ( size_t k=0; k<sums_.size(); ++k )
+            sums_[k] += x;
+        value_ = sums_.empty() ? 0 : sums_[0];
+        status_ = StatusCode::OK;
+    }
+
+    //Returns the slot of the sum for this horizon, adding it if it's new.
+    //A horizon added after the bank has started firing starts from zero.
+    size_t addHorizon(std::chrono::nanoseconds length) {
+        auto it = std::find(lengths_.begin(), lengths_.end(), length);
+        if ( it != lengths_.end() )
+            return it - lengths_.begin();
+        lengths_.push_back(length);
+        inv_lengths_.push_back(1.0 / length.count());
+        sums_.push_back(0);
+        return sums_.size() - 1;
+    }
+
+    double sum(size_t slot) const { return sums_[slot]; }
+    size_t numHorizons() const { return sums_.size(); }
+    std::chrono::nanoseconds horizon(size_t slot) const { return lengths_[slot]; }
+
+    std::string defaultName() const override {
+        return getClassName() + input_->getName() + Decay::nameSuffix(decay_kind_);
+    }
+
+    SERIALIZE(DecayedSumBank, input_, clock_, decay_kind_);
+
+    ValueNode* input_;
+    ClockNode* clock_;
+    Decay::Kind decay_kind_;
+
+    protected:
+    void decayAll(double elapsed_nanos) {
+        size_t n = sums_.size();
+        double* sums = sums_.data();
+        double const* inv_lengths = inv_lengths_.data();
+        if ( decay_kind_ == Decay::Kind::LINEAR ) {
+            for ( size_t k=0; k<n; ++k )
+                sums[k] *= std::max(0.0, 1.0 - elapsed_nanos * inv_lengths[k]);
+        } else {
+            for ( size_t k=0; k<n; ++k )
+                sums[k] *= Decay::expNeg(elapsed_nanos * inv_lengths[k]);
+        }
+    }
+
+    std::vector<std::chrono::nanoseconds> lengths_;
+    std::vector<double> inv_lengths_; //by slot
+    std::vector<double> sums_;        //by slot
+    int64_t last_decay_time_{0};
+
+    DecayedSumBank(Graph* g, ValueNode* input, ClockNode* clock,
+                   Decay::Kind decay_kind=Decay::Kind::LINEAR)
+        : ValueNode(g, input->units()),
+          input_(input),
+          clock_(clock),
+          decay_kind_(decay_kind) {
+        value_ = 0;
+        setParents(input);
+        setClock(clock);
+    }
+};
+
+//One horizon of a DecayedSumBank; lazy, so it only copies its sum out when read.
+struct DecayedSum : public ValueNode {
+    void compute() override {
+        value_ = bank_->sum(slot_);
+        status_ = StatusCode::OK;
+    }
+
+    bool stateless() const override { return true; }
+
+    std::string defaultName() const override {
+        return getClassName() + bank_->input_->getName() + getDurationString(length_)
+             + Decay::nameSuffix(bank_->decay_kind_);
+    }
+
+    SERIALIZE(DecayedSum, bank_, length_);
+
+    DecayedSumBank* bank_;
+    std::chrono::nanoseconds length_;
+
+    protected:
+    size_t slot_;
+
+    DecayedSum(Graph* g, DecayedSumBank* bank, std::chrono::nanoseconds length)
+        : ValueNode(g, bank->units()),
+          bank_(bank),
+          length_(length),
+          slot_(bank->addHorizon(length)) {
+        setParents(bank);
+        setClock(bank);
+        setLazy();
+    }
+};
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+//Bitset over a dense range of indices (plan slots, graph indices), sized at
+//runtime.  Words are exposed so callers can walk set bits in increasing order
+//while setting bits ahead of the cursor.
+struct DenseBitset {
+    using Word = uint64_t;
+    static constexpr size_t bitsPerWord = 64;
+
+    DenseBitset() = default;
+    explicit DenseBitset(size_t n) { resize(n); }
+
+    void resize(size_t n) {
+        words_.assign((n + bitsPerWord - 1) / bitsPerWord, 0);
+        size_ = n;
+    }
+    size_t size() const { return size_; }
+    void clear() { std::fill(words_.begin(), words_.end(), 0); }
+
+    bool test(size_t i) const { return (words_[i / bitsPerWord] >> (i % bitsPerWord)) & 1; }
+    void set(size_t i) { words_[i / bitsPerWord] |= Word(1) << (i % bitsPerWord); }
+    void reset(size_t i) { words_[i / bitsPerWord] &= ~(Word(1) << (i % bitsPerWord)); }
+
+    //returns the previous value
+    bool testAndSet(size_t i) {
+        bool was = test(i);
+        set(i);
+        return was;
+    }
+
+    size_t numWords() const { return words_.size(); }
+    Word& word(size_t w) { return words_[w]; }
+    Word word(size_t w) const { return words_[w]; }
+
+    template <typename Fun>
+    void forEach(Fun&& fun) const {
+        for(size_t w=0; w<words_.size(); ++w)
+            for(Word bits=words_[w]; bits; bits &= bits - 1)
+                fun(w * bitsPerWord + __builtin_ctzll(bits));
+    }
+
+    private:
+    std::vector<Word> words_;
+    size_t size_{0};
+};
@@ -0,0 +1,3 @@
+#include "model/expr_nodes.h"
+
+NODE_FACTORY_ADD(ScaledDiff);
@@ -0,0 +1,130 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "graph.h"
+#include "serialize.h"
+
+//Arithmetic over ValueNodes, fused into one node.
+//
+//A formula that would otherwise be a chain of helper nodes, each with its
+//own virtual compute and status, is written as a type, and Expr evaluates it
+//with one inlined, statically dispatched function:
+//
+//    //scale * (x - y)
+//    using ScaledDiffOp = Mul<Param<0>, Sub<Arg<0>, Arg<1>>>;
+//
+//Arg<i> is the i'th input node's heldValue() and Param<i> the i'th scalar.
+//An Expr isn't serializable on its own, since SERIALIZE needs a class name
+//and its members: name each formula by deriving from Expr<Op>, keep the
+//constructor arguments as members, SERIALIZE those and register the class
+//with NODE_FACTORY_ADD, as ScaledDiff below does.
+//
+//The node clocks on the union of its inputs' clocks, like the chain it
+//replaces, and is stateless.
+
+namespace expr {
+constexpr size_t maxOf(size_t a, size_t b) { return a > b ? a : b; }
+}
+
+template<size_t I>
+struct Arg {
+    static constexpr size_t inputs = I + 1;
+    static constexpr size_t params = 0;
+    static double eval(double const* x, double const*) { return x[I]; }
+};
+
+template<size_t I>
+struct Param {
+    static constexpr size_t inputs = 0;
+    static constexpr size_t params = I + 1;
+    static double eval(double const*, double const* p) { return p[I]; }
+};
+
+template<typename A>
+struct Neg {
+    static constexpr size_t inputs = A::inputs;
+    static constexpr size_t params = A::params;
+    static double eval(double const* x, double const* p) { return -A::eval(x, p); }
+};
+
+template<typename A, typename B>
+struct Add {
+    static constexpr size_t inputs = expr::maxOf(A::inputs, B::inputs);
+    static constexpr size_t params = expr::maxOf(A::params, B::params);
+    static double eval(double const* x, double const* p) { return A::eval(x, p) + B::eval(x, p); }
+};
+
+template<typename A, typename B>
+struct Sub {
+    static constexpr size_t inputs = expr::maxOf(A::inputs, B::inputs);
+    static constexpr size_t params = expr::maxOf(A::params, B::params);
+    static double eval(double const* x, double const* p) { return A::eval(x, p) - B::eval(x, p); }
+};
+
+template<typename A, typename B>
+struct Mul {
+    static constexpr size_t inputs = expr::maxOf(A::inputs, B::inputs);
+    static constexpr size_t params = expr::maxOf(A::params, B::params);
+    static double eval(double const* x, double const* p) { return A::eval(x, p) * B::eval(x, p); }
+};
+
+template<typename A, typename B>
+struct Div {
+    static constexpr size_t inputs = expr::maxOf(A::inputs, B::inputs);
+    static constexpr size_t params = expr::maxOf(A::params, B::params);
+    static double eval(double const* x, double const* p) { return A::eval(x, p) / B::eval(x, p); }
+};
+
+template<typename Op>
+struct Expr : public ValueNode {
+    static constexpr size_t numInputs = Op::inputs;
+    static constexpr size_t numParams = Op::params;
+    static_assert(numInputs > 0, "an Expr needs at least one input to clock on");
+
+    void compute() override {
+        double x[numInputs];
+        for ( size_t i=0; i<numInputs; ++i )
+            x[i] = inputs_[i]->heldValue();
+        value_ = Op::eval(x, params_.data());
+        status_ = StatusCode::OK;
+    }
+
+    bool stateless() const override { return true; }
+
+    protected:
+    std::array<ValueNode*, numInputs> inputs_;
+    std::array<double, numParams> params_;
+
+    Expr(Graph* g, std::array<double, numParams> params, std::array<ValueNode*, numInputs> inputs,
+         Units units=Units::NONE)
+        : ValueNode(g, units),
+          inputs_(inputs),
+          params_(params) {
+        std::vector<ValueNode*> nodes(inputs_.begin(), inputs_.end());
+        setParents(nodes);
+        setClock(nodes);
+    }
+};
+
+//scale * (x - y)
+struct ScaledDiff : public Expr<Mul<Param<0>, Sub<Arg<0>, Arg<1>>>> {
+    std::string defaultName() const override {
+        return getClassName() + std::to_string(scale_) + x_->getName() + y_->getName();
+    }
+
+    SERIALIZE(ScaledDiff, scale_, x_, y_);
+
+    double scale_;
+    ValueNode *x_, *y_;
+
+    protected:
+    ScaledDiff(Graph* g, double scale, ValueNode* x, ValueNode* y)
+        : Expr(g, {{scale}}, {{x, y}}, x->units()),
+          scale_(scale),
+          x_(x),
+          y_(y)
+    {}
+};
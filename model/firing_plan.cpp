@@ -0,0 +1,298 @@
+#include "model/firing_plan.h"
+#include "model/alloc_tracker.h"
+#include "model/cycle_clock.h"
+#include "model/graph.h"
+#include "model/node_profiler.h"
+#include "model/worker_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+void FiringPlan::clear() {
+    nodes_.clear();
+    kind_.clear();
+    clockBegin_.clear();
+    clockSlots_.clear();
+    parentBegin_.clear();
+    parentSlots_.clear();
+    callbackBegin_.clear();
+    callbackSlots_.clear();
+    refresh_.clear();
+    ticked_.clear();
+    valid_.clear();
+    lazy_.clear();
+    frontier_.resize(0);
+    fired_.clear();
+    levelBegin_.clear();
+    levelSlots_.clear();
+    cost_.clear();
+    nOrdered_ = 0;
+    compiled_ = false;
+    lastEventDriven_ = false;
+}
+
+void FiringPlan::compile(SourceNode* source, IsShared const& isShared) {
+    clear();
+    constexpr uint32_t noSlot = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> slots(source->getGraph()->nodes.size(), noSlot); //by Node::index()
+    nodes_.push_back(source);
+    slots[source->index()] = 0;
+    for(auto node : source->computeOrder_) {
+        slots[node->index()] = nodes_.size();
+        nodes_.push_back(node);
+    }
+    nOrdered_ = nodes_.size();
+
+    auto slotOf = [&](Node* node) -> uint32_t {
+        uint32_t& slot = slots[node->index()];
+        if(slot != noSlot)
+            return slot;
+        slot = nodes_.size();
+        nodes_.push_back(node);
+        refresh_.push_back(slot);
+        return slot;
+    };
+
+    kind_.resize(nOrdered_, Kind::GENERIC);
+    for(uint32_t slot=0; slot<nOrdered_; ++slot) {
+        Node* node = nodes_[slot];
+        clockBegin_.push_back(clockSlots_.size());
+        parentBegin_.push_back(parentSlots_.size());
+        callbackBegin_.push_back(callbackSlots_.size());
+        //computeOrder_ is the callback closure of the source, so every callback has an ordered slot
+        for(auto callback : node->callbacks_) {
+            assert(slots[callback->index()] < nOrdered_);
+            callbackSlots_.push_back(slots[callback->index()]);
+        }
+        if(slot == 0)
+            continue;
+        for(auto clock : node->clocks_)
+            clockSlots_.push_back(slotOf(clock));
+        for(auto parent : node->parents_)
+            parentSlots_.push_back(slotOf(parent));
+        if(node->isType<ValueNode>() and node->clocks_.size() == 1)
+            kind_[slot] = static_cast<ValueNode*>(node)->lazy() ? Kind::LAZY : Kind::VALUE;
+        if(isShared(node))
+            refresh_.push_back(slot);
+    }
+    clockBegin_.push_back(clockSlots_.size());
+    parentBegin_.push_back(parentSlots_.size());
+    callbackBegin_.push_back(callbackSlots_.size());
+
+    ticked_.assign(nodes_.size(), 0);
+    valid_.assign(nodes_.size(), 0);
+    lazy_.assign(nodes_.size(), 0);
+    for(uint32_t slot=0; slot<nodes_.size(); ++slot) {
+        valid_[slot] = nodes_[slot]->valid();
+        lazy_[slot] = nodes_[slot]->isType<ValueNode>() and static_cast<ValueNode*>(nodes_[slot])->lazy();
+    }
+    frontier_.resize(nOrdered_);
+    fired_.reserve(nOrdered_);
+
+    //Slots are in topological order, so a single pass assigns levels.
+    std::vector<uint32_t> level(nOrdered_, 0);
+    uint32_t nLevels = 1;
+    auto dependsOn = [&level, this](uint32_t slot, uint32_t dep) {
+        if(dep < nOrdered_)
+            level[slot] = std::max(level[slot], level[dep] + 1);
+    };
+    for(uint32_t slot=1; slot<nOrdered_; ++slot) {
+        for(uint32_t i=clockBegin_[slot]; i<clockBegin_[slot+1]; ++i)
+            dependsOn(slot, clockSlots_[i]);
+        for(uint32_t i=parentBegin_[slot]; i<parentBegin_[slot+1]; ++i)
+            dependsOn(slot, parentSlots_[i]);
+        nLevels = std::max(nLevels, level[slot] + 1);
+    }
+    //level 0 only holds the source, which isn't fired by the plan
+    levelBegin_.assign(nLevels + 1, 0);
+    for(uint32_t slot=1; slot<nOrdered_; ++slot)
+        ++levelBegin_[level[slot] + 1];
+    for(uint32_t l=1; l<=nLevels; ++l)
+        levelBegin_[l] += levelBegin_[l-1];
+    levelSlots_.resize(nOrdered_ - 1);
+    std::vector<uint32_t> fill(levelBegin_.begin(), levelBegin_.end() - 1);
+    for(uint32_t slot=1; slot<nOrdered_; ++slot)
+        levelSlots_[fill[level[slot]]++] = slot;
+    cost_.assign(nOrdered_, 0);
+    compiled_ = true;
+}
+
+void FiringPlan::refresh(SourceNode* source) {
+    for(auto slot : refresh_) {
+        ticked_[slot] = nodes_[slot]->ticked_;
+        valid_[slot] = nodes_[slot]->valid();
+    }
+    ticked_[0] = source->ticked_;
+    valid_[0] = source->valid();
+}
+
+//Stale lazy parents are computed first, as Node::parentsValid does.
+inline bool FiringPlan::parentsValid(uint32_t slot) {
+    for(uint32_t i=parentBegin_[slot]; i<parentBegin_[slot+1]; ++i) {
+        uint32_t parent = parentSlots_[i];
+        if(lazy_[parent])
+            evaluate(parent);
+        if(not valid_[parent])
+            return false;
+    }
+    return true;
+}
+
+//The node may already have been evaluated outside the plan, by a generic
+//child's Node::parentsValid, so valid_ is synced either way. It's only
+//written when it changes, so parallel readers of an evaluated slot don't race.
+inline void FiringPlan::evaluate(uint32_t slot) {
+    auto node = static_cast<ValueNode*>(nodes_[slot]);
+    node->evaluate();
+    uint8_t valid = node->valid();
+    if(valid_[slot] != valid)
+        valid_[slot] = valid;
+}
+
+inline void FiringPlan::fireSlot(SourceNode* source, uint32_t slot, NodeProfiler* profiler) {
+    source->currentNode(nodes_[slot]);
+    if(profiler) {
+        uint64_t start = readCycles();
+        computeSlot(slot);
+        profiler->record(nodes_[slot]->index(), readCycles() - start);
+    } else {
+        computeSlot(slot);
+    }
+}
+
+inline void FiringPlan::computeSlot(uint32_t slot) {
+    Node* node = nodes_[slot];
+    if(kind_[slot] != Kind::GENERIC) {
+        //Same logic as ValueNode::fire, with the clock and parents resolved to slots.
+        ++node->nFired;
+        if(not ticked_[clockSlots_[clockBegin_[slot]]]) {
+            ticked_[slot] = 0;
+            return;
+        }
+        node->ticked_ = true;
+        ++node->nTicked;
+        if(kind_[slot] == Kind::LAZY) {
+            static_cast<ValueNode*>(node)->stale_ = true;
+        } else if(parentsValid(slot)) {
+            ++node->nComputed;
+            node->compute();
+            if (not node->valid()) {
+                AllocationTracker::Pause diagnosticsMayAllocate;
+                LOG_INFO() << "Node invalid after compute() with parents all valid:  " << node->defaultName();
+            }
+        } else if(node->valid()) {
+            node->status_ = Node::StatusCode::INVALID;
+        }
+    } else {
+        node->fire();
+    }
+    ticked_[slot] = node->ticked_;
+    valid_[slot] = node->valid();
+}
+
+void FiringPlan::fire(SourceNode* source) {
+    refresh(source);
+    lastEventDriven_ = false;
+    NodeProfiler* profiler = source->getGraph()->profiler();
+    for(uint32_t slot=1; slot<nOrdered_; ++slot)
+        fireSlot(source, slot, profiler);
+    source->currentNode(nullptr);
+}
+
+void FiringPlan::fireEventDriven(SourceNode* source) {
+    refresh(source);
+    lastEventDriven_ = true;
+    NodeProfiler* profiler = source->getGraph()->profiler();
+    fired_.clear();
+    markCallbacks(0);
+    for(size_t w=0; w<frontier_.numWords(); ++w) {
+        DenseBitset::Word bits;
+        while((bits = frontier_.word(w)) != 0) {
+            uint32_t slot = w * DenseBitset::bitsPerWord + __builtin_ctzll(bits);
+            frontier_.word(w) = bits & (bits - 1);
+            fired_.push_back(slot);
+            fireSlot(source, slot, profiler);
+            if(ticked_[slot])
+                markCallbacks(slot);
+        }
+    }
+    source->currentNode(nullptr);
+}
+
+inline void FiringPlan::fireTimed(uint32_t slot, NodeProfiler* profiler) {
+    constexpr float alpha = 1.0f / 16;
+    uint64_t start = readCycles();
+    computeSlot(slot);
+    uint64_t cycles = readCycles() - start;
+    cost_[slot] += alpha * (cycles - cost_[slot]);
+    if(profiler)
+        profiler->record(nodes_[slot]->index(), cycles);
+}
+
+void FiringPlan::fireLevels(SourceNode* source, WorkerPool& workers, uint64_t minParallelCycles) {
+    refresh(source);
+    lastEventDriven_ = false;
+    NodeProfiler* profiler = source->getGraph()->profiler();
+    for(size_t l=1; l<numLevels(); ++l) {
+        uint32_t const* begin = &levelSlots_[levelBegin_[l]];
+        uint32_t width = levelWidth(l);
+        if(width == 1) {
+            //can never go parallel, so its cost isn't measured
+            fireSlot(source, begin[0], profiler);
+            continue;
+        }
+        float cost = 0;
+        for(uint32_t i=0; i<width; ++i)
+            cost += cost_[begin[i]];
+        if(cost >= minParallelCycles) {
+            //two slots of the level may share a stale lazy parent, so it's
+            //evaluated here rather than by whichever worker reads it first
+            for(uint32_t i=0; i<width; ++i)
+                for(uint32_t j=parentBegin_[begin[i]]; j<parentBegin_[begin[i]+1]; ++j)
+                    if(lazy_[parentSlots_[j]])
+                        evaluate(parentSlots_[j]);
+            //currentNode_ is a single pointer, so it's only set if a slot throws:
+            //the first slot to fail is the one whose exception is passed on
+            constexpr uint32_t noSlot = std::numeric_limits<uint32_t>::max();
+            std::atomic<uint32_t> failed{noSlot};
+            source->currentNode(nullptr);
+            try {
+                workers.parallelFor(width, [this, begin, profiler, &failed](size_t i) {
+                    try {
+                        fireTimed(begin[i], profiler);
+                    } catch(...) {
+                        uint32_t none = noSlot;
+                        if(failed.compare_exchange_strong(none, begin[i]))
+                            throw;
+                    }
+                });
+            } catch(...) {
+                source->currentNode(nodes_[failed.load()]);
+                throw;
+            }
+        } else {
+            for(uint32_t i=0; i<width; ++i) {
+                source->currentNode(nodes_[begin[i]]);
+                fireTimed(begin[i], profiler);
+            }
+        }
+    }
+    source->currentNode(nullptr);
+}
+
+void FiringPlan::reset() {
+    if(lastEventDriven_) {
+        for(auto slot : fired_) {
+            nodes_[slot]->reset();
+            ticked_[slot] = 0;
+        }
+    } else {
+        resetAll();
+    }
+}
+
+void FiringPlan::resetAll() {
+    for(uint32_t slot=1; slot<nOrdered_; ++slot)
+        nodes_[slot]->reset();
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "model/dense_bitset.h"
+
+struct Node;
+struct SourceNode;
+struct WorkerPool;
+struct NodeProfiler;
+
+//FiringPlan is a flattened copy of a SourceNode's computeOrder_.  Clocks and
+//parents are resolved to slot indices once, when the plan is compiled, so the
+//per-event walk reads ticked/valid flags out of dense arrays instead of
+//chasing clocks_/parents_ pointers through every Node.
+//
+//Slot 0 is the source itself, slots [1, nOrdered_) follow computeOrder_, and
+//any clock or parent that is not in computeOrder_ gets an external slot after
+//that.  External slots, and slots shared with other sources' plans, can change
+//status outside of this plan, so they are re-read at the start of each event.
+//
+//fireEventDriven() only visits callbacks of clocks that actually ticked, using
+//a frontier bitset over the ordered slots.  Since slots are in topological
+//order, callbacks are always marked ahead of the cursor.  This relies on nodes
+//doing nothing unless one of their clocks ticked, which holds for ValueNode
+//and ClockNode::fire.
+//
+//fireLevels() runs the ordered slots level by level, where a slot's level is
+//one more than the highest level among its ordered clocks and parents. Slots
+//in the same level don't depend on each other, so wide levels are fanned out
+//across a WorkerPool. Every slot's cost is measured in cycles, and a level only
+//goes parallel once its measured cost exceeds the threshold; cheap levels
+//aren't worth the hand-off.
+struct FiringPlan {
+    //VALUE nodes have ValueNode::fire semantics (which is final), so the plan
+    //runs that logic inline. LAZY nodes are ValueNodes that are only marked
+    //stale, to be computed when read, including by a child's parentsValid().
+    //Everything else goes through the virtual fire().
+    enum class Kind : uint8_t { VALUE, LAZY, GENERIC };
+
+    using IsShared = std::function<bool(Node*)>;
+
+    void compile(SourceNode* source, IsShared const& isShared);
+    void clear();
+    bool compiled() const { return compiled_; }
+
+    void fire(SourceNode* source);
+    void fireEventDriven(SourceNode* source);
+    void fireLevels(SourceNode* source, WorkerPool& workers, uint64_t minParallelCycles);
+    void reset(); //resets ticked_ on the nodes fired by the last event
+    void resetAll(); //resets ticked_ on every ordered node but the source
+
+    //slots visited by the last fireEventDriven, in firing order
+    std::vector<uint32_t> const& fired() const { return fired_; }
+
+    size_t size() const { return nOrdered_; }
+    size_t numSlots() const { return nodes_.size(); } //ordered and external
+    Node* node(uint32_t slot) const { return nodes_[slot]; }
+
+    size_t numLevels() const { return levelBegin_.empty() ? 0 : levelBegin_.size() - 1; }
+    uint32_t levelWidth(size_t level) const { return levelBegin_[level+1] - levelBegin_[level]; }
+    float cost(uint32_t slot) const { return cost_[slot]; } //moving average, in cycles
+
+    private:
+    void refresh(SourceNode* source);
+    void fireSlot(SourceNode* source, uint32_t slot, NodeProfiler* profiler);
+    void computeSlot(uint32_t slot);
+    void fireTimed(uint32_t slot, NodeProfiler* profiler);
+    void markCallbacks(uint32_t slot) {
+        for(uint32_t i=callbackBegin_[slot]; i<callbackBegin_[slot+1]; ++i)
+            frontier_.set(callbackSlots_[i]);
+    }
+    bool parentsValid(uint32_t slot);
+    void evaluate(uint32_t slot); //computes a stale lazy slot
+
+    std::vector<Node*> nodes_;          //by slot
+    std::vector<Kind> kind_;            //by ordered slot
+    std::vector<uint32_t> clockBegin_;  //by ordered slot, plus one end marker
+    std::vector<uint32_t> clockSlots_;
+    std::vector<uint32_t> parentBegin_; //by ordered slot, plus one end marker
+    std::vector<uint32_t> parentSlots_;
+    std::vector<uint32_t> callbackBegin_; //by ordered slot, plus one end marker
+    std::vector<uint32_t> callbackSlots_;
+    std::vector<uint32_t> refresh_;     //slots re-read at the start of each event
+    std::vector<uint8_t> ticked_;       //by slot
+    std::vector<uint8_t> valid_;        //by slot
+    std::vector<uint8_t> lazy_;         //by slot, lazy ValueNodes
+    DenseBitset frontier_;              //by ordered slot
+    std::vector<uint32_t> fired_;
+    std::vector<uint32_t> levelBegin_;  //by level, plus one end marker
+    std::vector<uint32_t> levelSlots_;  //ordered slots but the source, grouped by level
+    std::vector<float> cost_;           //by ordered slot
+    uint32_t nOrdered_{0};
+    bool compiled_{false};
+    bool lastEventDriven_{false};
+};
@@ -3,29 +3,27 @@
 #include "model/data_grab/data_grabber.h"
 #include "model/config.h"
 
+#include <algorithm>
 #include <cmath>
 #include <string>
 #include <sstream>
 #include <fstream>
 #include <cstdlib>
 #include <chrono>
-
-bool Graph::hasCycleUtil(Node* node,
-              std::unordered_set<Node*>& visited,
-              std::unordered_set<Node*>& recursed) {
-    if(!visited.count(node)) {
-        visited.emplace(node);
-        recursed.emplace(node);
-
-        for(auto child : node->children_)
-            if(!visited.count(child)) {
-                if(hasCycleUtil(child, visited, recursed))
-                    return true;
-            }
-            else if(recursed.count(child))
-                return true;
-        recursed.erase(node);
-    }
+#include <limits>
+
+DepthFirstSearch::DepthFirstSearch(Graph const* g)
+    : visited_(g->nodes.size())
+    , onPath_(g->nodes.size())
+{}
+
+bool Graph::isCyclic() {
+    DepthFirstSearch search(this);
+    auto noop = [](Node*) {};
+    auto isCycle = [](Node*) { return true; };
+    for(auto node : nodes)
+        if ( not search.run(node, &DepthFirstSearch::childEdge, noop, isCycle) )
+            return true;
     return false;
 }
 
@@ -58,6 +56,8 @@ bool Graph::hasSymmetricEdges() {
 Node* Graph::firingNode() {
     if(currentSource_)
         return currentSource_->currentNode();
+    else if(burstSource())
+        return burstSource()->currentNode();
     else
         return nullptr;
 }
@@ -76,7 +76,236 @@ void Graph::onInitFinished()
         throw ConfigError("Invalid graph: probably cyclic");
     else
         LOG_INFO() << "onInitFinished: valid graph";
-    
+
+    for(auto node : nodes)
+        if(node->isType<ValueNode>())
+            static_cast<ValueNode*>(node)->checkLazy();
+
+    //inside a transaction, the plans are compiled by the first fire after it commits
+    if(not inBuildTransaction()) {
+        commitBuild();
+        compileFiringPlans();
+    }
+}
+
+void Graph::unregisterSource(SourceNode* source) {
+    sources_.erase(std::remove(sources_.begin(), sources_.end(), source), sources_.end());
+    pendingOrders_.erase(std::remove(pendingOrders_.begin(), pendingOrders_.end(), source), pendingOrders_.end());
+}
+
+void Graph::deferOrderUpdate(SourceNode* source) {
+    if(not source->orderPending_) {
+        invalidateFiringPlans();
+        source->orderPending_ = true;
+        pendingOrders_.push_back(source);
+    }
+}
+
+void Graph::commitBuild() {
+    if(pendingOrders_.empty())
+        return;
+    invalidateFiringPlans();
+
+    //Kahn sort of everything reachable from the dirty sources, over both
+    //callback and child edges.
+    std::vector<Node*> reached;
+    DepthFirstSearch search(this);
+    for(auto source : pendingOrders_)
+        applyDepthFirstImpl(source, search, true, [&reached](Node* n) {reached.push_back(n);});
+
+    std::vector<uint32_t> inDegree(nodes.size(), 0);
+    for(auto n : reached) {
+        for(auto c : n->callbacks_) ++inDegree[c->index()];
+        for(auto c : n->children_) ++inDegree[c->index()];
+    }
+    std::vector<Node*> ready;
+    for(auto n : reached)
+        if(inDegree[n->index()] == 0)
+            ready.push_back(n);
+
+    constexpr uint32_t unranked = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> rank(nodes.size(), unranked);
+    uint32_t nextRank = 0;
+    auto release = [&](Node* c) {
+        if(--inDegree[c->index()] == 0)
+            ready.push_back(c);
+    };
+    while(not ready.empty()) {
+        Node* n = ready.back();
+        ready.pop_back();
+        rank[n->index()] = nextRank++;
+        for(auto c : n->callbacks_) release(c);
+        for(auto c : n->children_) release(c);
+    }
+    //nodes on a cycle never reach zero in-degree; rank them last so they're
+    //still fired. onInitFinished rejects cyclic graphs anyway.
+    for(auto n : reached)
+        if(rank[n->index()] == unranked)
+            rank[n->index()] = nextRank++;
+
+    for(auto source : pendingOrders_) {
+        source->orderPending_ = false;
+        auto& order = source->computeOrder_;
+        order.clear();
+        traverseCallbacks(source, [&order, source](Node* n) {
+            if(n != source) order.push_back(n);
+        });
+        std::sort(order.begin(), order.end(), [&rank](Node* a, Node* b) {
+            return rank[a->index()] < rank[b->index()];
+        });
+    }
+    pendingOrders_.clear();
+}
+
+void Graph::compileFiringPlans() {
+    std::vector<int> planCount(nodes.size(), 0);
+    for(auto source : sources_)
+        for(auto node : source->computeOrder_)
+            ++planCount[node->index()];
+    auto isShared = [&planCount](Node* node) { return planCount[node->index()] > 1; };
+    for(auto source : sources_) {
+        source->plan_.compile(source, isShared);
+        auto mds = dynamic_cast<MarketDataSource*>(source);
+        source->latencySlot_ = latency_.registerSlot(mds ? mds->shortSymbol() : source->getName());
+    }
+    computeSourceComponents();
+    if(profiling_)
+        profiler_.resize(nodes.size());
+}
+
+void Graph::computeSourceComponents() {
+    //union-find over positions in sources_
+    std::vector<uint32_t> parent(sources_.size());
+    for(uint32_t s=0; s<parent.size(); ++s)
+        parent[s] = s;
+    auto find = [&parent](uint32_t s) {
+        while(parent[s] != s)
+            s = parent[s] = parent[parent[s]];
+        return s;
+    };
+    auto join = [&](uint32_t a, uint32_t b) { parent[find(a)] = find(b); };
+
+    //A plan writes its ordered slots, the source included, and only reads
+    //its external slots.
+    constexpr uint32_t noWriter = std::numeric_limits<uint32_t>::max();
+    std::vector<uint32_t> writer(nodes.size(), noWriter);
+    for(uint32_t s=0; s<sources_.size(); ++s) {
+        auto const& plan = sources_[s]->plan_;
+        for(uint32_t slot=0; slot<plan.size(); ++slot) {
+            uint32_t& w = writer[plan.node(slot)->index()];
+            if(w == noWriter)
+                w = s;
+            else
+                join(s, w);
+        }
+    }
+    for(uint32_t s=0; s<sources_.size(); ++s) {
+        auto const& plan = sources_[s]->plan_;
+        for(uint32_t slot=plan.size(); slot<plan.numSlots(); ++slot) {
+            uint32_t w = writer[plan.node(slot)->index()];
+            if(w != noWriter)
+                join(s, w);
+        }
+    }
+
+    std::vector<uint32_t> component(sources_.size(), noWriter);
+    numSourceComponents_ = 0;
+    for(uint32_t s=0; s<sources_.size(); ++s) {
+        uint32_t& c = component[find(s)];
+        if(c == noWriter)
+            c = numSourceComponents_++;
+        sources_[s]->component_ = c;
+    }
+    burstGroups_.resize(numSourceComponents_);
+}
+
+void Graph::setWorkerThreads(size_t nThreads) {
+    if(nThreads == 0)
+        workers_.reset();
+    else if(not workers_ or workers_->size() != nThreads)
+        workers_.reset(new WorkerPool(nThreads));
+}
+
+void Graph::startLatencyReporter(std::chrono::milliseconds interval) {
+    latencyReporter_.reset();
+    if(interval.count() > 0)
+        latencyReporter_.reset(new LatencyReporter(latency_, interval));
+}
+
+void Graph::setProfiling(bool enabled) {
+    profiling_ = enabled;
+    if(enabled)
+        profiler_.resize(nodes.size());
+}
+
+void Graph::setLevelParallel(size_t nThreads, uint64_t minParallelCycles,
+                             std::vector<int> const& cpus) {
+    minParallelCycles_ = minParallelCycles;
+    if(nThreads == 0)
+        levelWorkers_.reset();
+    else
+        levelWorkers_.reset(new WorkerPool(nThreads, cpus, true));
+}
+
+void Graph::fireBurst(std::vector<SourceNode*> const& sources) {
+    if(sources.empty())
+        return;
+    if(not sources.front()->plan_.compiled())
+        compileFiringPlans();
+
+    burstComponents_.clear();
+    if(workers_) {
+        for(auto source : sources) {
+            auto& group = burstGroups_[source->component_];
+            if(group.empty())
+                burstComponents_.push_back(source->component_);
+            group.push_back(source);
+        }
+    }
+    if(burstComponents_.size() < 2) {
+        for(auto source : sources)
+            source->fire();
+        for(auto c : burstComponents_)
+            burstGroups_[c].clear();
+        return;
+    }
+
+    assert(getStrategy() == nullptr || // OK: we are doing tests
+           mutex_.locked.test_and_set(std::memory_order_acquire));
+    #ifndef NDEBUG
+    for(auto node : nodes)
+        node->reset();
+    #endif
+
+    //The whole burst is timed and logged as one event.
+    notifyPreFire(nullptr);
+    eventId_ += sources.size() - 1;
+    try {
+        workers_->parallelFor(burstComponents_.size(), [this](size_t i) {
+            struct Clear { ~Clear() { burstSource() = nullptr; } } clear;
+            for(auto source : burstGroups_[burstComponents_[i]]) {
+                burstSource() = source;
+                #ifndef NDEBUG
+                source->plan_.resetAll();
+                source->reset();
+                #endif
+                source->fireComputeOrder();
+            }
+        });
+    } catch(...) {
+        for(auto c : burstComponents_)
+            burstGroups_[c].clear();
+        throw;
+    }
+    notifyPostFire();
+
+    for(auto c : burstComponents_)
+        burstGroups_[c].clear();
+}
+
+void Graph::invalidateFiringPlans() {
+    for(auto source : sources_)
+        source->plan_.clear();
 }
 
 std::string Graph::graphViz() {
@@ -177,8 +406,8 @@ void Graph::nodeAudit(Node* node)
                << clockMsg
                << '\n';
 
-    std::set<SourceNode*> sources;
-    std::set<ClockNode*> nonsource_clocks;
+    std::set<SourceNode*, NodeIdLess> sources;
+    std::set<ClockNode*, NodeIdLess> nonsource_clocks;
     auto accumParentSources = [&] (Node* n) -> void {
         SourceNode* sn = dynamic_cast<SourceNode*>(n);
         if(sn) {
@@ -200,8 +429,8 @@ void Graph::nodeAudit(Node* node)
         if ((s->nTicked<2) and (not dynamic_cast<OnAny*>(s)))
             LOG_INFO() << "\t\t" << s->getName() << "\t " << s->nTickedTrue << "/" << s->nTicked;
 
-    std::set<Node*> invalids;
-    std::set<Node*> invalidsValidParents;
+    NodeSet invalids;
+    NodeSet invalidsValidParents;
     auto accumInvalids = [&] (Node* n) -> void {
         if(n->status() != Node::StatusCode::OK)
         {
@@ -225,8 +454,10 @@ void Graph::nodeAudit(Node* node)
 void Graph::notifyPreFire(SourceNode* source) {
     #ifndef NDEBUG
     auto it = std::find(graphVizEvent_.begin(), graphVizEvent_.end(), eventId_);
-    if(it != graphVizEvent_.end())
+    if(it != graphVizEvent_.end()) {
+        AllocationTracker::Pause diagnosticsMayAllocate;
         saveGraphViz("graph_" + std::to_string(eventId_));
+    }
 
     if(nodeStatus_.size() != nodes.size()) {
         nodeStatus_.clear();
@@ -241,70 +472,60 @@ void Graph::notifyPreFire(SourceNode* source) {
     uptime_ = startFireTime_ - startNSec_;
     ++eventId_;
 
-    #ifndef PRODUCTION_BUILD
-    auto dt = wallTStartFire_ - wallTEndFire_;
-    auto dtNSec = std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
-    double dtUSec = dtNSec / 1000.0;
-    histogram_.update("interEvent", dtUSec);        
-    #endif
+    latency_.record(interEventSlot_, wallTStartFire_ - wallTEndFire_);
 }
 
 
 void Graph::notifyPostFire()
 {
     #ifndef NDEBUG
-    size_t i=0;
-    bool hasStatusChange = false;
-    std::vector<Node*> newlyInvalid;
-    for(auto* n: nodes) {
-        if(nodeStatus_.at(i) != n->status()) {
-            LOG_INFO() << "NodeStatus change " << nodeStatus_[i] << " -> " << n->status()
-                       << " Node=" << n->getName() << " "
-                       << " Source=" << currentSource_->getName();
-            if(not n->valid()) {
-                bool allParentsValid = n->parentsValid();
-                bool allParentsInvalid = true;
-                for(auto* p:n->parents()) {
-                    if(p->status_ != Node::StatusCode::INVALID) {
-                        allParentsInvalid = false;
-                        break;
-                    }
-                }
-                std::string msg = allParentsValid ? "all valid." : ( allParentsInvalid ? "all invalid." : "various status:");
-                LOG_INFO() << "    Status of parents:" << msg;
-                if(not allParentsValid and not allParentsInvalid) {
+    {
+        AllocationTracker::Pause diagnosticsMayAllocate;
+        size_t i=0;
+        bool hasStatusChange = false;
+        std::vector<Node*> newlyInvalid;
+        for(auto* n: nodes) {
+            if(nodeStatus_.at(i) != n->status()) {
+                LOG_INFO() << "NodeStatus change " << nodeStatus_[i] << " -> " << n->status()
+                           << " Node=" << n->getName() << " "
+                           << " Source=" << (currentSource_ ? currentSource_->getName() : "burst");
+                if(not n->valid()) {
+                    bool allParentsValid = n->parentsValid();
+                    bool allParentsInvalid = true;
                     for(auto* p:n->parents()) {
-                        LOG_INFO() << "        " << p->getName() << ':' << p->status();
+                        if(p->status_ != Node::StatusCode::INVALID) {
+                            allParentsInvalid = false;
+                            break;
+                        }
+                    }
+                    std::string msg = allParentsValid ? "all valid." : ( allParentsInvalid ? "all invalid." : "various status:");
+                    LOG_INFO() << "    Status of parents:" << msg;
+                    if(not allParentsValid and not allParentsInvalid) {
+                        for(auto* p:n->parents()) {
+                            LOG_INFO() << "        " << p->getName() << ':' << p->status();
+                        }
                     }
                 }
-            }
 
-            hasStatusChange = true;
-            nodeStatus_[i] = n->status();
+                hasStatusChange = true;
+                nodeStatus_[i] = n->status();
+            }
+            ++i;
         }
-        ++i;
+        if(hasStatusChange)
+            for(auto n: nodesToAudit_)
+                nodeAudit(n);
     }
-    if(hasStatusChange)
-        for(auto n: nodesToAudit_)
-            nodeAudit(n);
     #endif
     
-    #ifndef PRODUCTION_BUILD
     wallTEndFire_ = wallClock::now();
-    auto dt = wallTEndFire_ - wallTStartFire_;
-    auto dtNSec = std::chrono::duration_cast<std::chrono::nanoseconds>(dt).count();
-    double dtUSec = dtNSec / 1000.0;
-    auto mds = dynamic_cast<MarketDataSource*>(currentSource_);
-    if ( mds != nullptr) {
-        // auto order_book = mds->orderBook();
-        std::string desc = mds->shortSymbol(); // + (order_book->isTradeEvent()?"Trade":"Quote");
-        histogram_.update(desc, dtUSec);
-    } else {
-        histogram_.update(currentSource_->getName(), dtUSec);
-    }
+    latency_.record(currentSource_ ? currentSource_->latencySlot_ : burstSlot_,
+                    wallTEndFire_ - wallTStartFire_);
 
+    #ifndef PRODUCTION_BUILD
     if(0 == (eventId_ & (eventId_ - 1)) and eventId_ > 1000) // On eventId_ == power of two and > 1000
     {
+        AllocationTracker::Pause diagnosticsMayAllocate;
         for(auto n: nodesToAudit_)
             nodeAudit(n);
     }
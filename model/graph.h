@@ -1,13 +1,18 @@
 #pragma once
 
 
-#include "model/histogram.h"
+#include "model/alloc_tracker.h"
+#include "model/firing_plan.h"
+#include "model/latency_recorder.h"
 #include "model/node.h"
+#include "model/node_arena.h"
+#include "model/node_profiler.h"
 #include "model/serialize_utils.h"
+#include "model/worker_pool.h"
 
+#include <exception>
 #include <vector>
 #include <set>
-#include <unordered_set>
 
 #include <lib/factory.h>
 #include <lib/JSON.h>
@@ -22,6 +27,8 @@
 #include <gtest/gtest_prod.h>
 
 #include <chrono>
+#include <exception>
+#include <memory>
 
 // create "has_create"
 HAS_MEM_FUN(create)
@@ -41,8 +48,8 @@ struct Graph {
     using cleanup_fun = void(*)(void);
 
     std::set<cleanup_fun> cleanup_funs;
-    std::set<Node*> nodes; 
-    std::vector<Node::StatusCode> nodeStatus_;
+    std::vector<Node*> nodes; //indexed by Node::index()
+    std::vector<Node::StatusCode> nodeStatus_; //indexed by Node::index()
 
     // Nodes that will be deserialized after the valuation and order logic.
     std::vector<ValueNode*> utilityNodes_;
@@ -53,43 +60,37 @@ struct Graph {
         , wallTEndFire_(wallClock::now())
         , currentSource_(nullptr)
         , strategyPtr_(strategyPtr) 
-        , histogram_(500, 10, 50000)
+        , interEventSlot_(latency_.registerSlot("interEvent"))
+        , burstSlot_(latency_.registerSlot("burst"))
     {}
     
     Graph(Graph const& that) = delete;
 
     virtual ~Graph() {
+        latencyReporter_.reset();
         for(auto& fun : cleanup_funs)
             fun();
         cleanup_funs.clear();
+        //Node destructors have run by now; drop their storage in one go.
+        arena_.release();
     }
 
     Strategy* getStrategy() const;
 
+    //Nodes of type T, in registration order.
     template<typename T>
-    std::set<T*> getNodes() const {
-        std::set<T*> r;
+    std::vector<T*> getNodes() const {
+        std::vector<T*> r;
         for(Node* n: nodes)
             if(nullptr != dynamic_cast<T*>(n))
-                r.insert(dynamic_cast<T*>(n));
+                r.push_back(dynamic_cast<T*>(n));
         return r;
     }
 
     // This is called during vpl::onInitFinished
     void onInitFinished();
 
-    bool hasCycleUtil(Node* node,
-                  std::unordered_set<Node*>& visited,
-                  std::unordered_set<Node*>& recursed);
-
-    bool isCyclic() {
-        std::unordered_set<Node*> visited; 
-        std::unordered_set<Node*> recursed;
-        for(auto node : nodes)
-            if ( hasCycleUtil(node, visited, recursed) )
-                return true;
-        return false;
-    }
+    bool isCyclic();
 
     //verifies parent_/children_ and clocks_/callbacks_ are symmetric
     bool hasSymmetricEdges();
@@ -106,19 +107,110 @@ struct Graph {
 
     //Called only from Node constructor
     void registerNode(Node* node) {
-        nodes.insert(node);
+        node->index_ = nodes.size();
+        nodes.push_back(node);
     }
 
     std::vector<Node*> constructOrder_;
     void addToConstructOrder(Node* n) {
-        if(std::find(constructOrder_.begin(), constructOrder_.end(), n) == constructOrder_.end())
+        if(inConstructOrder_.size() < nodes.size())
+            inConstructOrder_.resize(nodes.size(), false);
+        if(not inConstructOrder_[n->index()]) {
+            inConstructOrder_[n->index()] = true;
             constructOrder_.push_back(n);
+        }
     }
     std::vector<Node*> const& constructOrder() {return constructOrder_;}
+
+    //Called only from SourceNode constructor/destructor
+    void registerSource(SourceNode* source) { sources_.push_back(source); }
+    void unregisterSource(SourceNode* source);
+    std::vector<SourceNode*> const& sources() const { return sources_; }
+
+    //Compiles the FiringPlan of every source. Plans are compiled together so
+    //nodes shared between sources can be flagged for a status refresh.
+    void compileFiringPlans();
+    void invalidateFiringPlans();
+
+    //Sources are split into components when their plans are compiled: two
+    //sources are in the same component if one's plan reads or writes a node
+    //that the other's plan writes. fireBurst fires the sources of a burst
+    //component by component, running different components concurrently on
+    //the worker pool, while sources within a component fire serially in the
+    //order given. Nodes are never touched by two threads at once.
+    //Components only follow graph edges: state a node reads through a stored
+    //pointer that isn't a parent or clock (e.g. a market_data_ member used for
+    //tickSize()) isn't covered, and such a node must be given the edge.
+    //An exception thrown by a source is rethrown from fireBurst once the
+    //burst's other components have finished.
+    void setWorkerThreads(size_t nThreads);
+    size_t numSourceComponents() const { return numSourceComponents_; }
+    void fireBurst(std::vector<SourceNode*> const& sources);
+
+    //While a BuildTransaction is open, SourceNode::treeUpdated only marks the
+    //source dirty. When the outermost transaction closes, every dirty source's
+    //computeOrder_ is rebuilt from one Kahn sort of the graph. Graph::add and
+    //Graph::deserialize open one, so a whole deserialized strategy is sorted once.
+    //A transaction unwound by an exception doesn't commit, but one that is
+    //merely opened during unwinding (e.g. by a destructor) still does.
+    struct BuildTransaction {
+        BuildTransaction(Graph* g) : g_(g), uncaught_(std::uncaught_exceptions()) { ++g_->buildDepth_; }
+        ~BuildTransaction() {
+            if ( --g_->buildDepth_ == 0 and std::uncaught_exceptions() == uncaught_ )
+                g_->commitBuild();
+        }
+        BuildTransaction(BuildTransaction const&) = delete;
+        Graph* g_;
+        int uncaught_;
+    };
+    bool inBuildTransaction() const { return buildDepth_ > 0; }
+    //Also invalidates the firing plans, which no longer match the graph.
+    void deferOrderUpdate(SourceNode* source);
+    void commitBuild();
+
+    //In event-driven mode sources only visit the callbacks of clocks that
+    //ticked, rather than every node in their computeOrder_.
+    void setEventDriven(bool eventDriven) { eventDriven_ = eventDriven; }
+    bool eventDriven() const { return eventDriven_; }
+
+    //In level-parallel mode each source fires its plan level by level (see
+    //FiringPlan::fireLevels), running levels whose measured cost is at least
+    //minParallelCycles on a pool of nThreads spinning workers, pinned to cpus
+    //if given. Takes precedence over event-driven mode, except inside
+    //fireBurst, where sources already run concurrently. nThreads == 0 turns it off.
+    void setLevelParallel(size_t nThreads, uint64_t minParallelCycles = 20000,
+                          std::vector<int> const& cpus = {});
+    WorkerPool* levelWorkers() const { return levelWorkers_.get(); }
+    uint64_t minParallelCycles() const { return minParallelCycles_; }
+
+    //Opt-in per-node cost profiling; see NodeProfiler. Costs a cycle counter
+    //read per fired node while enabled, nothing when disabled.
+    void setProfiling(bool enabled);
+    NodeProfiler* profiler() const { return profiling_ ? &profiler_ : nullptr; }
+    void profileReport(std::ostream& os) const { profiler_.report(os, nodes); }
+
+    //Event latencies, recorded per source and between events. Sources get
+    //their slot when firing plans are compiled, which onInitFinished does.
+    LatencyRecorder const& latency() const { return latency_; }
+    //Logs the latencies of every interval from a background thread; 0 stops it.
+    void startLatencyReporter(std::chrono::milliseconds interval);
+
+    //Tests and benchmarks: once eventId() reaches warmupEvents, every
+    //SourceNode::fire throws if it allocates on the heap. See AllocationTracker.
+    void setAllocationCheck(bool enabled, int warmupEvents = 100) {
+        allocationCheck_ = enabled;
+        allocationWarmup_ = warmupEvents;
+    }
+    bool checkingAllocations() const {
+        return allocationCheck_ and eventId_ >= allocationWarmup_;
+    }
+
     template <typename T, typename... Args> 
     T* add(Args... args) {
         static_assert(std::is_base_of<Serializable, T>::value, "T is not derived from Serializable");
         static_assert(has_create<T, Graph*, Args...>::value, "T does not have a create function");
+        NodeArena::Scope arenaScope(arena_);
+        BuildTransaction transaction(this);
         auto memoizedCreate = memoize(utils::getCreateFunc<T>());
         auto item = memoizedCreate(this, std::forward<Args>(args)...);
         addToConstructOrder(item);
@@ -167,6 +259,7 @@ struct Graph {
     template<typename T>
     T* deserialize(Parameters const& p) {
         auto type = p["type"].get<std::string>();
+        BuildTransaction transaction(this);
 
         LOG_INFO() << "Graph:deserializing: " << deserLogIndent_ << type;
         deserLogIndent_ += " ";
@@ -184,6 +277,15 @@ struct Graph {
             
             throw std::logic_error(errMsg);
         }
+
+        //"lazy": true makes a stateless ValueNode compute on read, see ValueNode::setLazy
+        auto lazy = p.find("lazy");
+        if ( lazy != p.end() ) {
+            auto valueNode = dynamic_cast<ValueNode*>(rawStruct);
+            if ( !valueNode )
+                throw ConfigError("Graph::deserialize: only ValueNodes can be lazy: " + type);
+            valueNode->setLazy(lazy->get<bool>());
+        }
         
         LOG_INFO() << "...with name " << deserLogIndent_ << node->getName();
         deserLogIndent_.pop_back();
@@ -204,7 +306,13 @@ struct Graph {
     void notifyPostFire();
 
     SourceNode const* currentSource() const {
-        return currentSource_;
+        return currentSource_ ? currentSource_ : burstSource();
+    }
+
+    //Source being fired by this thread within fireBurst.
+    static SourceNode*& burstSource() {
+        static thread_local SourceNode* source = nullptr;
+        return source;
     }
 
     int64_t nSecUptime() {
@@ -218,6 +326,8 @@ struct Graph {
     
     lib::spinlock mutex_;    
 
+    NodeArena const& arena() const { return arena_; }
+
     void addNodeToAudit(Node* node) { nodesToAudit_.push_back(node); }
     void nodeAudit(Node* node);
 
@@ -232,7 +342,27 @@ struct Graph {
     Strategy* strategyPtr_;
     void setStrategy(Strategy* strategy);
 
-    Histogram histogram_;
+    LatencyRecorder latency_;
+    LatencyRecorder::Handle interEventSlot_;
+    LatencyRecorder::Handle burstSlot_;
+    std::unique_ptr<LatencyReporter> latencyReporter_;
+    NodeArena arena_;
+    std::vector<SourceNode*> sources_;
+    std::vector<SourceNode*> pendingOrders_;
+    void computeSourceComponents();
+    size_t numSourceComponents_{0};
+    std::unique_ptr<WorkerPool> workers_;
+    std::unique_ptr<WorkerPool> levelWorkers_;
+    uint64_t minParallelCycles_{0};
+    mutable NodeProfiler profiler_;
+    bool profiling_{false};
+    bool allocationCheck_{false};
+    int allocationWarmup_{0};
+    std::vector<std::vector<SourceNode*>> burstGroups_; //by component
+    std::vector<uint32_t> burstComponents_;             //non-empty burstGroups_
+    std::vector<bool> inConstructOrder_;
+    int buildDepth_{0};
+    bool eventDriven_{false};
     std::vector<int> graphVizEvent_;
     std::vector<Node*> nodesToAudit_;
     
@@ -242,72 +372,129 @@ struct Graph {
     }
 };
 
+//Iterative depth-first traversal engine shared by the helpers below. It keeps
+//an explicit stack, so deep chains can't overflow the call stack, and marks
+//visited nodes by Node::index(), so all nodes must be in the same graph.
+//
+//edge(node, i) returns node's i-th outgoing edge, or nullptr once they are
+//exhausted. post(node) is applied after all of node's descendants. If an edge
+//leads back onto the current path, onCycle(node) is called, and the traversal
+//stops and returns false if it returns true.
+struct DepthFirstSearch {
+    DepthFirstSearch(Graph const* g);
+
+    template <typename Edge, typename Post, typename OnCycle>
+    bool run(Node* root, Edge edge, Post post, OnCycle onCycle) {
+        if ( visited_.testAndSet(root->index()) )
+            return true;
+        push(root);
+        while ( not stack_.empty() ) {
+            Frame& top = stack_.back();
+            Node* next = edge(top.node, top.next++);
+            if ( next ) {
+                if ( not visited_.testAndSet(next->index()) )
+                    push(next);
+                else if ( onPath_.test(next->index()) and onCycle(next) ) {
+                    for(auto& frame : stack_)
+                        onPath_.reset(frame.node->index());
+                    stack_.clear();
+                    return false;
+                }
+                continue;
+            }
+            Node* done = top.node;
+            stack_.pop_back();
+            onPath_.reset(done->index());
+            post(done);
+        }
+        return true;
+    }
+
+    template <typename Edge, typename Post>
+    void run(Node* root, Edge edge, Post post) {
+        run(root, edge, post, [](Node*) { return false; });
+    }
+
+    bool visited(Node const* node) const { return visited_.test(node->index()); }
+
+    //Edge functions for run()
+    static Node* callbackEdge(Node* n, size_t i) {
+        return i < n->callbacks().size() ? n->callbacks()[i] : nullptr;
+    }
+    static Node* childEdge(Node* n, size_t i) {
+        return i < n->children().size() ? n->children()[i] : nullptr;
+    }
+    static Node* callbackOrChildEdge(Node* n, size_t i) {
+        auto nCallbacks = n->callbacks().size();
+        return i < nCallbacks ? n->callbacks()[i] : childEdge(n, i - nCallbacks);
+    }
+
+    private:
+    struct Frame {
+        Node* node;
+        size_t next;
+    };
+    void push(Node* node) {
+        onPath_.set(node->index());
+        stack_.push_back({node, 0});
+    }
+
+    DenseBitset visited_;
+    DenseBitset onPath_;
+    std::vector<Frame> stack_;
+};
+
 //Function templates for graph traversal required by SourceNode:
 //Note: this DFS implementation works for cyclic graphs as well
 template <typename Fun, typename ...Args>
-void applyDepthFirstImpl(Node* node, std::set<Node*>& visited, 
+void applyDepthFirstImpl(Node* node, DepthFirstSearch& search, 
          bool applyToAllChildren, Fun func, Args&... args) {
-    if ( visited.find(node) != visited.end() )
-        return;
-    visited.emplace(node);
-
-    std::set<Node*> children(node->callbacks_.begin(),
-                             node->callbacks_.end());
+    auto post = [&](Node* n) { func(n, args...); };
     if ( applyToAllChildren )
-        children.insert(node->children_.begin(), node->children_.end());
-    
-    for(auto otherNode : children)
-        applyDepthFirstImpl(otherNode, visited, applyToAllChildren,
-                            func, args...);
-
-    func(node, args...);
-    return;
+        search.run(node, &DepthFirstSearch::callbackOrChildEdge, post);
+    else
+        search.run(node, &DepthFirstSearch::callbackEdge, post);
 }
 
 template <typename Fun, typename ...Args>
 void traverseCallbacks(Node* root, Fun func, Args&... args) {
-    std::set<Node*> visited;
-    applyDepthFirstImpl(root, visited, false, func, args...);
+    DepthFirstSearch search(root->getGraph());
+    applyDepthFirstImpl(root, search, false, func, args...);
 }
 
 template <typename Fun, typename ...Args>
 void traverseChildren(Node* root, Fun func, Args&... args) {
-    std::set<Node*> visited;
-    applyDepthFirstImpl(root, visited, true, func, args...);
+    DepthFirstSearch search(root->getGraph());
+    applyDepthFirstImpl(root, search, true, func, args...);
 }
 
 template<typename FUNC>
 void applyToDependencies(Node* root, FUNC f)
 {
-    std::unordered_map<Node*, std::set<Node*>> prerequisit;
-    for(auto n: root->getGraph()->nodes)
+    auto const& nodes = root->getGraph()->nodes;
+    std::vector<std::vector<Node*>> prerequisit(nodes.size());
+    for(auto n: nodes)
     {
         for(auto c: n->callbacks())
-            prerequisit[c].insert(n);
+            prerequisit[c->index()].push_back(n);
         for(auto c: n->children())
-            prerequisit[c].insert(n);
+            prerequisit[c->index()].push_back(n);
     }
-    std::set<Node*> visited;
-    std::function<void(Node*)> applyImpl; // Recursive lambda: https://stackoverflow.com/a/4081391
-    applyImpl = [&](Node*n) -> void
-        {
-            if(visited.count(n))
-                return;
-            visited.insert(n);
-            for(auto dep: prerequisit[n])
-                applyImpl(dep);
-            f(n);
-        };
-    applyImpl(root);
-    return;
+    auto dependency = [&prerequisit](Node* n, size_t i) -> Node* {
+        auto const& deps = prerequisit[n->index()];
+        return i < deps.size() ? deps[i] : nullptr;
+    };
+    DepthFirstSearch search(root->getGraph());
+    search.run(root, dependency, f);
 }
 
+//onlyInclude, if given, is indexed by Node::index()
 inline
 void topological_sort(Node* root, std::vector<Node*>& order,
-         lib::optional<std::set<Node*>> onlyInclude=lib::optional<std::set<Node*>>()) {
-    auto appendNode = [&order, &onlyInclude] (Node* node) {
+         DenseBitset const* onlyInclude=nullptr) {
+    auto appendNode = [&order, onlyInclude] (Node* node) {
         if ( onlyInclude ) {
-            if ( onlyInclude.get().count(node) )
+            if ( onlyInclude->test(node->index()) )
                 order.emplace_back(node);
         } else {
             order.emplace_back(node);
@@ -344,17 +531,25 @@ void addDirectCallbacks(Set& set, Node* node) {
 struct SourceNode : public ClockNode {
     SourceNode(Graph* g) 
         : ClockNode(g), currentNode_(nullptr) {
+        g->registerSource(this);
         treeUpdated();
     }
-    virtual ~SourceNode() = default;
+    virtual ~SourceNode() {
+        getGraph()->unregisterSource(this);
+    }
 
     //This must be called whenever a node changes its children_ or callbacks_.
     virtual void treeUpdated() {
+        if ( getGraph()->inBuildTransaction() ) {
+            getGraph()->deferOrderUpdate(this);
+            return;
+        }
+        getGraph()->invalidateFiringPlans();
         computeOrder_.clear();
-        std::set<Node*> callbacks;
+        DenseBitset callbacks(getGraph()->nodes.size());
         std::vector<Node*> fullSort;
-        addAllCallbacks(callbacks, this);
-        topological_sort(this, fullSort, callbacks);
+        traverseCallbacks(this, [&callbacks](Node* node) {callbacks.set(node->index());});
+        topological_sort(this, fullSort, &callbacks);
         assert(*fullSort.begin() == this);
         for( auto node : fullSort )
             if ( node != this )
@@ -369,11 +564,6 @@ struct SourceNode : public ClockNode {
         assert(getGraph()->getStrategy() == nullptr || // OK: we are doing tests
                getGraph()->mutex_.locked.test_and_set(std::memory_order_acquire));
         
-        ++nFired;
-        ++nComputed;
-        ++nTicked;
-        ++nTickedTrue;
-        
         // In debug, reset before firing, so ticked_ remains viewable after this call.
         // The nodes that need reseting are the nodes in the computeOrder_ of the
         // last source node (and that node) that fired. But as we don't know which are those node
@@ -383,23 +573,41 @@ struct SourceNode : public ClockNode {
             node->reset();
         #endif
 
-        status_ = StatusCode::OK;
-        ticked_ = true;
+        //computeOrder_ is stale until the transaction commits
+        assert(not getGraph()->inBuildTransaction());
+        if ( not plan_.compiled() )
+            getGraph()->compileFiringPlans();
+        AllocationTracker::Scope allocations(getGraph()->checkingAllocations() ? this : nullptr);
         getGraph()->notifyPreFire(this);
-        for(auto node : computeOrder_)
-        {
-            currentNode(node);
-            node->fire();
-        }
-        currentNode(nullptr);
+        fireComputeOrder();
         getGraph()->notifyPostFire();
+        allocations.check();
+    }
+
+    //Fires computeOrder_ without the Graph-level bookkeeping of fire(). Only
+    //touches nodes in this source's plan, so Graph::fireBurst calls it from
+    //worker threads for sources in different components.
+    void fireComputeOrder() {
+        ++nFired;
+        ++nComputed;
+        ++nTicked;
+        ++nTickedTrue;
+
+        status_ = StatusCode::OK;
+        ticked_ = true;
+        Graph* g = getGraph();
+        if ( g->levelWorkers() and not Graph::burstSource() )
+            plan_.fireLevels(this, *g->levelWorkers(), g->minParallelCycles());
+        else if ( g->eventDriven() )
+            plan_.fireEventDriven(this);
+        else
+            plan_.fire(this);
 
         // Reset after firing in prod for efficiency
         // Contrarlily to the debug case, we know the only nodes that need
         // reseting are the ones in the computeOrder_ and this one.
         #ifdef NDEBUG
-        for (auto node : computeOrder_)  
-            node->reset();
+        plan_.reset();
         this->reset();
         #endif
     }
@@ -408,6 +616,10 @@ struct SourceNode : public ClockNode {
     ClockSet getSourceClockSet() override final { return ClockSet{this}; }
 
     std::vector<Node*> computeOrder_;
+    FiringPlan plan_;
+    bool orderPending_{false}; //set while waiting on a BuildTransaction
+    uint32_t component_{0};    //see Graph::fireBurst
+    LatencyRecorder::Handle latencySlot_{0}; //registered with the firing plan
 
     Node* currentNode() {return currentNode_;}
     void currentNode(Node* n) {currentNode_=n;}
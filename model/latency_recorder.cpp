@@ -0,0 +1,92 @@
+#include "model/latency_recorder.h"
+
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include <lib/vplat_log.h>
+
+LatencyRecorder::Handle LatencyRecorder::registerSlot(std::string const& key) {
+    std::lock_guard<std::mutex> lock(registerMutex_);
+    auto it = handles_.find(key);
+    if(it != handles_.end())
+        return it->second;
+    size_t n = nSlots_.load(std::memory_order_relaxed);
+    if(n == maxSlots)
+        throw std::logic_error("LatencyRecorder: too many slots registering " + key);
+    slots_[n].reset(new Slot);
+    slots_[n]->key = key;
+    handles_[key] = n;
+    nSlots_.store(n + 1, std::memory_order_release);
+    return n;
+}
+
+LatencyRecorder::Snapshot LatencyRecorder::snapshot(Handle h) const {
+    Slot const& slot = *slots_[h];
+    Snapshot s;
+    s.key = slot.key;
+    s.count = slot.count.load(std::memory_order_relaxed);
+    s.sumNanos = slot.sumNanos.load(std::memory_order_relaxed);
+    s.maxNanos = slot.maxNanos.load(std::memory_order_relaxed);
+    for(size_t b=0; b<LogBuckets::numBuckets; ++b)
+        s.buckets[b] = slot.buckets[b].load(std::memory_order_relaxed);
+    return s;
+}
+
+std::vector<LatencyRecorder::Snapshot> LatencyRecorder::snapshotAll() const {
+    std::vector<Snapshot> all;
+    size_t n = size();
+    for(Handle h=0; h<n; ++h)
+        all.push_back(snapshot(h));
+    return all;
+}
+
+LatencyRecorder::Snapshot& LatencyRecorder::Snapshot::operator-=(Snapshot const& earlier) {
+    count -= earlier.count;
+    sumNanos -= earlier.sumNanos;
+    for(size_t b=0; b<LogBuckets::numBuckets; ++b)
+        buckets[b] -= earlier.buckets[b];
+    return *this;
+}
+
+void LatencyRecorder::report(std::ostream& os, std::vector<Snapshot> const& snapshots) {
+    os << std::setw(24) << "key" << std::setw(12) << "count" << std::setw(10) << "mean"
+       << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+       << std::setw(12) << "max" << "  (nanos)\n";
+    for(auto const& s : snapshots) {
+        if(s.count == 0)
+            continue;
+        os << std::setw(24) << s.key << std::setw(12) << s.count
+           << std::setw(10) << s.sumNanos / s.count
+           << std::setw(10) << s.percentile(0.5) << std::setw(10) << s.percentile(0.99)
+           << std::setw(10) << s.percentile(0.999) << std::setw(12) << s.maxNanos << '\n';
+    }
+}
+
+LatencyReporter::LatencyReporter(LatencyRecorder const& recorder, std::chrono::milliseconds interval)
+    : recorder_(recorder), interval_(interval), thread_([this] { run(); })
+{}
+
+LatencyReporter::~LatencyReporter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+}
+
+void LatencyReporter::run() {
+    std::vector<LatencyRecorder::Snapshot> previous;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(not wake_.wait_for(lock, interval_, [this] { return stop_; })) {
+        auto current = recorder_.snapshotAll();
+        auto interval = current;
+        for(size_t i=0; i<previous.size(); ++i)
+            interval[i] -= previous[i];
+        std::ostringstream os;
+        LatencyRecorder::report(os, interval);
+        LOG_INFO() << "Event latency over the last " << interval_.count() << "ms:\n" << os.str();
+        previous.swap(current);
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "model/log_buckets.h"
+
+//Per-source event latency histograms, cheap enough to leave on in production.
+//
+//Keys are registered once, off the firing path, and turned into integer
+//handles. record() is then a handful of relaxed atomic adds into the slot's
+//LogBuckets histogram: no strings, no lookups, no locks. Slots are never
+//moved or freed while the recorder lives, so a reporter thread can snapshot
+//them at any time without coordinating with the firing thread.
+struct LatencyRecorder {
+    using Handle = uint32_t;
+    static constexpr size_t maxSlots = 1024;
+
+    struct Snapshot {
+        std::string key;
+        uint64_t count{0};
+        uint64_t sumNanos{0};
+        uint64_t maxNanos{0};
+        std::array<uint64_t, LogBuckets::numBuckets> buckets{};
+
+        uint64_t percentile(double p) const { return LogBuckets::percentile(buckets, count, p); }
+        Snapshot& operator-=(Snapshot const& earlier); //counts since earlier; max stays the running max
+    };
+
+    LatencyRecorder() : slots_(maxSlots) {}
+    LatencyRecorder(LatencyRecorder const&) = delete;
+
+    //Returns the existing handle if key is already registered. Not for the firing path.
+    Handle registerSlot(std::string const& key);
+
+    void record(Handle h, std::chrono::nanoseconds latency) {
+        Slot& slot = *slots_[h];
+        uint64_t nanos = latency.count() > 0 ? latency.count() : 0;
+        slot.count.fetch_add(1, std::memory_order_relaxed);
+        slot.sumNanos.fetch_add(nanos, std::memory_order_relaxed);
+        slot.buckets[LogBuckets::bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+        if(nanos > slot.maxNanos.load(std::memory_order_relaxed))
+            slot.maxNanos.store(nanos, std::memory_order_relaxed); //racy max is fine for reporting
+    }
+
+    size_t size() const { return nSlots_.load(std::memory_order_acquire); }
+    Snapshot snapshot(Handle h) const;
+    std::vector<Snapshot> snapshotAll() const;
+
+    static void report(std::ostream& os, std::vector<Snapshot> const& snapshots);
+
+    private:
+    struct Slot {
+        std::string key;
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> sumNanos{0};
+        std::atomic<uint64_t> maxNanos{0};
+        std::array<std::atomic<uint64_t>, LogBuckets::numBuckets> buckets{};
+    };
+
+    std::vector<std::unique_ptr<Slot>> slots_; //sized once; only [0, nSlots_) are set
+    std::atomic<size_t> nSlots_{0};
+    std::mutex registerMutex_;
+    std::map<std::string, Handle> handles_;
+};
+
+//Background thread that logs what a LatencyRecorder recorded over each interval.
+struct LatencyReporter {
+    LatencyReporter(LatencyRecorder const& recorder, std::chrono::milliseconds interval);
+    ~LatencyReporter();
+    LatencyReporter(LatencyReporter const&) = delete;
+
+    private:
+    void run();
+
+    LatencyRecorder const& recorder_;
+    std::chrono::milliseconds interval_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_{false};
+    std::thread thread_;
+};
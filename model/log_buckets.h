@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//HDR-style bucketing of non-negative integers: values below 16 get a bucket
+//each, above that every power of two is split into 8 sub-buckets, so a
+//bucket's floor is within about 12% of any value in it. Shared by the
+//NodeProfiler and LatencyRecorder histograms.
+struct LogBuckets {
+    static constexpr size_t subBucketBits = 3;
+    static constexpr size_t linearBuckets = 2 << subBucketBits;
+    static constexpr size_t numBuckets = linearBuckets + (64 - subBucketBits - 1) * (1 << subBucketBits);
+
+    static size_t bucketOf(uint64_t v) {
+        if(v < linearBuckets)
+            return v;
+        size_t e = 63 - __builtin_clzll(v);
+        return linearBuckets + (e - subBucketBits - 1) * (1 << subBucketBits)
+             + ((v >> (e - subBucketBits)) & ((1 << subBucketBits) - 1));
+    }
+
+    static uint64_t bucketFloor(size_t b) {
+        if(b < linearBuckets)
+            return b;
+        size_t k = b - linearBuckets;
+        size_t e = k / (1 << subBucketBits) + subBucketBits + 1;
+        uint64_t sub = k % (1 << subBucketBits);
+        return ((uint64_t(1) << subBucketBits) + sub) << (e - subBucketBits);
+    }
+
+    //Floor of the bucket holding the p-th quantile, given per-bucket counts.
+    template <typename Counts>
+    static uint64_t percentile(Counts const& counts, uint64_t total, double p) {
+        if(total == 0)
+            return 0;
+        uint64_t rank = p * total + 0.5;
+        if(rank == 0)
+            rank = 1;
+        uint64_t seen = 0;
+        for(size_t b=0; b<numBuckets; ++b) {
+            seen += counts[b];
+            if(seen >= rank)
+                return bucketFloor(b);
+        }
+        return bucketFloor(numBuckets - 1);
+    }
+};
@@ -2,12 +2,35 @@
 #include "graph.h"
 #include "clocks.h"
 #include "market_data.h"
+#include "node_arena.h"
 
 unsigned int Node::count = 0;
 
+//Every Node allocation carries a header recording the arena it came from
+//(nullptr for the heap), so operator delete knows whether to free it.
+static constexpr size_t nodeHeaderSize = NodeArena::alignment;
+
+void* Node::operator new(size_t size) {
+    NodeArena* arena = NodeArena::current();
+    void* raw = arena ? arena->allocate(size + nodeHeaderSize)
+                      : ::operator new(size + nodeHeaderSize);
+    *static_cast<NodeArena**>(raw) = arena;
+    return static_cast<char*>(raw) + nodeHeaderSize;
+}
+
+void Node::operator delete(void* p) {
+    if(not p)
+        return;
+    void* raw = static_cast<char*>(p) - nodeHeaderSize;
+    if(*static_cast<NodeArena**>(raw) == nullptr)
+        ::operator delete(raw);
+    //arena memory is released with the Graph
+}
+
 Node::Node(Graph* g)
     : graph_(g)
     , id_(Node::count++)
+    , index_(0)
     , name_("")
     , nFired(0)
     , nTicked(0)
@@ -37,9 +60,12 @@ void Node::treeUpdated() {
 }
 
 bool Node::parentsValid() { 
-    for(auto parent : parents_)
+    for(auto parent : parents_) {
+        if(parent->stale_)
+            static_cast<ValueNode*>(parent)->evaluate();
         if(not parent->valid())
             return false;
+    }
     return true;
 }
 
@@ -64,8 +90,7 @@ void Node::setClockImpl(const NodeSet& nodes) {
     if ( hasClock(clock)==false ) {
         clocks_.emplace_back(clock);
         clock->callbacks_.emplace_back(this);
-        auto cbs = clock->callbacks_;
-        assert(std::count(cbs.begin(), cbs.end(), this)==1);
+        assert(std::count(clock->callbacks_.begin(), clock->callbacks_.end(), this)==1);
     }     
     assert(clocks_.size()==1);
 
@@ -81,8 +106,55 @@ void Node::setClockImpl(const NodeSet& nodes) {
     treeUpdated();
 }
 
+thread_local unsigned ValueNode::lazyEvaluations_ = 0;
+
+void ValueNode::setLazy(bool lazy) {
+    if(lazy == lazy_)
+        return;
+    if(lazy)
+        checkCanBeLazy();
+    else
+        evaluate(); //don't leave an eager node holding a stale value
+    lazy_ = lazy;
+    treeUpdated();
+}
+
+void ValueNode::checkLazy() {
+    if(lazy_)
+        checkCanBeLazy();
+}
+
+void ValueNode::checkCanBeLazy() {
+    std::string errMsg = getClassName() + "::setLazy : ";
+    if(not stateless())
+        throw std::logic_error(errMsg + "only stateless nodes can be lazy");
+    for(auto parent : parents_) {
+        auto valueParent = dynamic_cast<ValueNode*>(parent);
+        if(valueParent and valueParent->getClock() != getClock())
+            throw std::logic_error(errMsg + "lazy node has a parent on another clock: " + parent->getName());
+    }
+}
+
+void ValueNode::evaluate() {
+    if(not stale_)
+        return;
+    stale_ = false;
+    struct Evaluating {
+        Evaluating() { ++lazyEvaluations_; }
+        ~Evaluating() { --lazyEvaluations_; }
+    } evaluating;
+    if ( parentsValid() ) {
+        ++nComputed;
+        compute();
+    } else if ( valid() ) {
+        status_ = StatusCode::INVALID;
+    }
+}
+
 Value ValueNode::heldValue() const
 {
+    const_cast<ValueNode*>(this)->evaluate();
+
     #ifndef NDEBUG
     if(not valid())
         throw std::logic_error(getClassName() + "::value : "
@@ -108,8 +180,9 @@ Value ValueNode::heldValue() const
     return value_;
 }
 Value ValueNode::value() {
+    evaluate();
     #ifndef NDEBUG
-    if(not ticked())
+    if(not ticked() and lazyEvaluations_ == 0)
         throw std::logic_error(getClassName() + "::value : "
             "Node's value is not current. " 
             "If this is expected, use heldValue instead");
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "model/alloc_tracker.h"
+#include "model/dense_bitset.h"
 #include "model/serialize_utils.h"
 
 #include <set>
@@ -21,9 +23,16 @@ struct Graph;
 struct ClockNode;
 struct ValueNode;
 struct CodeGenAccessor;                                      
+struct FiringPlan;
 
-using ClockSet = std::set<ClockNode*>;
-using NodeSet = std::set<Node*>;
+//Node sets are ordered by id rather than by pointer, so iterating them (and
+//hence the order parents/clocks are attached in) is deterministic.
+struct NodeIdLess {
+    bool operator()(Node const* lhs, Node const* rhs) const;
+};
+
+using ClockSet = std::set<ClockNode*, NodeIdLess>;
+using NodeSet = std::set<Node*, NodeIdLess>;
 using Value = double;
 using Parameters = JSON;
 
@@ -39,13 +48,19 @@ struct Node : Serializable {
     virtual ~Node() = default;
     Node(Node const& that) = delete;
 
+    //Nodes created inside Graph::add are placed in the graph's NodeArena;
+    //any other heap-allocated node goes to the global heap.
+    static void* operator new(size_t size);
+    static void* operator new(size_t, void* where) { return where; }
+    static void operator delete(void* p);
+    static void operator delete(void*, void*) {}
+
     void setParent(Node* parent) {
         assert(inSameGraph(parent, this));
         if ( hasParent(parent)==false ) {
             parents_.emplace_back(parent);
             parent->children_.emplace_back(this);
-            auto kids = parent->children_;
-            assert(std::count(kids.begin(), kids.end(), this)==1);
+            assert(std::count(parent->children_.begin(), parent->children_.end(), this)==1);
             treeUpdated();
         }
     }
@@ -134,14 +149,18 @@ struct Node : Serializable {
     auto numCallbacks() { return callbacks_.size(); }
 
     int id() const {return id_;}
+    //dense index of this node within its graph, in registration order
+    uint32_t index() const {return index_;}
 
     virtual void audit() {}
     
     protected:
     Graph* graph_;
     const int id_;
+    uint32_t index_;
     StatusCode status_{StatusCode::INIT}; 
     bool ticked_{false};
+    bool stale_{false}; //only lazy ValueNodes are ever stale, see ValueNode::setLazy
     std::vector<ClockNode*> clocks_;
     std::vector<Node*> callbacks_;
     std::vector<Node*> parents_;
@@ -153,10 +172,7 @@ struct Node : Serializable {
     
     friend Graph;
     friend CodeGenAccessor;                                      
-
-    template <typename Fun, typename ...Args>
-    friend void applyDepthFirstImpl(
-        Node*, std::set<Node*>&, bool, Fun, Args&... );
+    friend FiringPlan;
 
     FRIEND_TEST(test_graph, factory_dtor);
     FRIEND_TEST(test_order_logic, deserialize);
@@ -164,6 +180,10 @@ struct Node : Serializable {
 
 std::ostream& operator<<(std::ostream& os, Node::StatusCode const& s);
 
+inline bool NodeIdLess::operator()(Node const* lhs, Node const* rhs) const {
+    return lhs->id() < rhs->id();
+}
+
 //Base class for all clock-type nodes
 struct ClockNode : public Node {
     ClockNode(Graph* g) : Node(g) {
@@ -181,8 +201,7 @@ struct ClockNode : public Node {
             if ( hasClock(clock)==false ) {
                 clocks_.emplace_back(clock);
                 clock->callbacks_.emplace_back(this);
-                auto cbs = clock->callbacks_;
-                assert(std::count(cbs.begin(), cbs.end(), this)==1);
+                assert(std::count(clock->callbacks_.begin(), clock->callbacks_.end(), this)==1);
             }
             if ( node->isType<ClockNode>()==false ) {
                 addParent(node);
@@ -200,7 +219,10 @@ struct ClockNode : public Node {
                     compute();
                     ++nComputed;
                     nTickedTrue += ticked_;
-                    if (not valid()) LOG_INFO() << "Node invalid after compute() with parents all valid:  " << defaultName();
+                    if (not valid()) {
+                        AllocationTracker::Pause pause;
+                        LOG_INFO() << "Node invalid after compute() with parents all valid:  " << defaultName();
+                    }
                 } else {
                     if ( valid() ) //don't change status if INIT or other non-OK
                         status_ = StatusCode::INVALID;
@@ -220,8 +242,8 @@ NodeSet combineNodesImpl(T* node) {
     return nodes;
 }
 
-template<typename T>
-NodeSet combineNodesImpl(const std::set<T*>& nodes) {
+template<typename T, typename Compare>
+NodeSet combineNodesImpl(const std::set<T*, Compare>& nodes) {
     return NodeSet{nodes.begin(), nodes.end()};
 }
 
@@ -265,16 +287,36 @@ struct ValueNode : public Node {
     Value value();
     Value heldValue() const;
     ClockNode* getClock() override final; 
+
+    //Lazy nodes are marked stale when their clock ticks, and only compute()
+    //when they're next read: by value() or heldValue(), or by a child checking
+    //parentsValid(), which evaluates stale parents first. Only stateless nodes
+    //whose ValueNode parents share their clock can be lazy; setLazy throws
+    //otherwise. A graph deserialized from json takes "lazy": true on a node.
+    void setLazy(bool lazy=true);
+    bool lazy() const { return lazy_; }
+    bool stale() const { return stale_; }
+    void evaluate(); //computes a stale lazy node; no-op otherwise
+    void checkLazy(); //throws std::logic_error if a lazy node can't be evaluated on demand
+
+    //True if compute() keeps no state between calls, and everything it reads
+    //only changes when the node's clock ticks. Accumulators must stay false.
+    virtual bool stateless() const { return false; }
  
     virtual void fire() override final {
         ++nFired;
         if ( getClock()->ticked() ) { 
             ticked_ = true;
             ++nTicked;
-            if ( parentsValid() ) {
+            if ( lazy_ ) {
+                stale_ = true;
+            } else if ( parentsValid() ) {
                 ++nComputed;
                 compute(); 
-                if (not valid()) LOG_INFO() << "Node invalid after compute() with parents all valid:  " << defaultName();
+                if (not valid()) {
+                    AllocationTracker::Pause pause;
+                    LOG_INFO() << "Node invalid after compute() with parents all valid:  " << defaultName();
+                }
             } else {
                 //only change status if it's currently OK.
                 //if it's currently INIT, changing it will FUBAR stuff
@@ -288,6 +330,13 @@ struct ValueNode : public Node {
     protected:
     Value value_;
     const Units units_;
+    bool lazy_{false};
+    void checkCanBeLazy();
+    //depth of lazy evaluations on this thread; parents read by a late
+    //evaluation are no longer ticked, but still hold the values it needs
+    static thread_local unsigned lazyEvaluations_;
+
+    friend FiringPlan;
 };
 
 struct MarketData;
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+//Bump allocator owned by a Graph.  Nodes created through Graph::add are placed
+//here in construction order, so nodes built together (and usually fired
+//together) sit next to each other in memory.  Individual deallocation is a
+//no-op; the blocks are released all at once when the Graph is torn down.
+struct NodeArena {
+    static constexpr size_t alignment = alignof(std::max_align_t);
+
+    explicit NodeArena(size_t blockSize = 256 * 1024) : blockSize_(blockSize) {}
+    NodeArena(NodeArena const&) = delete;
+    ~NodeArena() { release(); }
+
+    void* allocate(size_t size) {
+        size = (size + alignment - 1) & ~(alignment - 1);
+        if(blocks_.empty() or used_ + size > blockCapacity_) {
+            size_t capacity = std::max(blockSize_, size);
+            void* block = std::aligned_alloc(alignment, capacity);
+            if(not block)
+                throw std::bad_alloc();
+            blocks_.push_back(block);
+            blockCapacity_ = capacity;
+            used_ = 0;
+        }
+        void* p = static_cast<char*>(blocks_.back()) + used_;
+        used_ += size;
+        bytesAllocated_ += size;
+        return p;
+    }
+
+    void release() {
+        for(auto block : blocks_)
+            std::free(block);
+        blocks_.clear();
+        used_ = blockCapacity_ = bytesAllocated_ = 0;
+    }
+
+    size_t bytesAllocated() const { return bytesAllocated_; }
+    size_t numBlocks() const { return blocks_.size(); }
+
+    //Arena that Node::operator new allocates from on this thread; set by Graph::add.
+    static NodeArena*& current() {
+        static thread_local NodeArena* arena = nullptr;
+        return arena;
+    }
+
+    struct Scope {
+        Scope(NodeArena& arena) : previous_(current()) { current() = &arena; }
+        ~Scope() { current() = previous_; }
+        NodeArena* previous_;
+    };
+
+    private:
+    size_t blockSize_;
+    std::vector<void*> blocks_;
+    size_t blockCapacity_{0};
+    size_t used_{0};
+    size_t bytesAllocated_{0};
+};
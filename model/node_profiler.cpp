@@ -0,0 +1,69 @@
+#include "model/node_profiler.h"
+#include "model/node.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include <string>
+
+void NodeProfiler::Stats::merge(Stats const& that) {
+    calls += that.calls;
+    cycles += that.cycles;
+    for(size_t b=0; b<numBuckets; ++b)
+        buckets[b] += that.buckets[b];
+}
+
+uint64_t NodeProfiler::Stats::percentile(double p) const {
+    return LogBuckets::percentile(buckets, calls, p);
+}
+
+void NodeProfiler::clear() {
+    for(auto& s : stats_)
+        s = Stats();
+}
+
+namespace {
+using Table = std::map<std::string, NodeProfiler::Stats>;
+
+void printTable(std::ostream& os, std::string const& title, Table const& table, uint64_t total) {
+    std::vector<Table::const_iterator> rows;
+    for(auto it = table.begin(); it != table.end(); ++it)
+        rows.push_back(it);
+    std::sort(rows.begin(), rows.end(), [](auto a, auto b) {
+        return a->second.cycles > b->second.cycles;
+    });
+
+    os << title << '\n'
+       << std::setw(8) << "self%" << std::setw(16) << "cycles" << std::setw(12) << "calls"
+       << std::setw(10) << "mean" << std::setw(10) << "p50" << std::setw(10) << "p99"
+       << "  name\n";
+    for(auto row : rows) {
+        auto const& s = row->second;
+        os << std::fixed << std::setprecision(2)
+           << std::setw(8) << (total ? 100.0 * s.cycles / total : 0.0)
+           << std::setw(16) << s.cycles << std::setw(12) << s.calls
+           << std::setw(10) << (s.calls ? s.cycles / s.calls : 0)
+           << std::setw(10) << s.percentile(0.5) << std::setw(10) << s.percentile(0.99)
+           << "  " << row->first << '\n';
+    }
+}
+}
+
+void NodeProfiler::report(std::ostream& os, std::vector<Node*> const& nodes) const {
+    Table byClass, byName;
+    uint64_t total = 0;
+    for(auto node : nodes) {
+        if(node->index() >= stats_.size())
+            continue;
+        auto const& s = stats_[node->index()];
+        if(s.calls == 0)
+            continue;
+        total += s.cycles;
+        byClass[node->getClassName()].merge(s);
+        byName[node->getName()].merge(s);
+    }
+    os << "Node firing cost, " << total << " cycles in total\n";
+    printTable(os, "By class:", byClass, total);
+    os << '\n';
+    printTable(os, "By node:", byName, total);
+}
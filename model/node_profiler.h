@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "model/log_buckets.h"
+
+struct Node;
+
+//Opt-in per-node cost profiler. While enabled (Graph::setProfiling), every
+//node fired by a FiringPlan is timed with the cycle counter, and the cycles
+//go into a LogBuckets histogram kept per node, by Node::index().
+//
+//report() aggregates by node class and by node name and prints both tables
+//sorted by total cycles, most expensive first.
+struct NodeProfiler {
+    static constexpr size_t numBuckets = LogBuckets::numBuckets;
+
+    struct Stats {
+        uint64_t calls{0};
+        uint64_t cycles{0};
+        std::array<uint32_t, numBuckets> buckets{};
+
+        void add(uint64_t c) {
+            ++calls;
+            cycles += c;
+            ++buckets[bucketOf(c)];
+        }
+        void merge(Stats const& that);
+        uint64_t percentile(double p) const;
+    };
+
+    //Sizes the per-node table; must be called before firing with new nodes.
+    void resize(size_t nNodes) { stats_.resize(nNodes); }
+    void clear();
+
+    //Not synchronized: concurrent calls must be for different nodes.
+    void record(uint32_t nodeIndex, uint64_t cycles) { stats_[nodeIndex].add(cycles); }
+    Stats const& stats(uint32_t nodeIndex) const { return stats_[nodeIndex]; }
+
+    void report(std::ostream& os, std::vector<Node*> const& nodes) const;
+
+    static size_t bucketOf(uint64_t c) { return LogBuckets::bucketOf(c); }
+    static uint64_t bucketFloor(size_t b) { return LogBuckets::bucketFloor(b); }
+
+    private:
+    std::vector<Stats> stats_; //by Node::index()
+};
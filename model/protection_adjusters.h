@@ -19,11 +19,11 @@ struct LowLiquidity : public ValueNode {
     void compute() override {
         double current_depth{0};
         if ( use_counts_ ) {
-            current_depth = book_depth_->bidCountToLevel(max_depth_) + 
-                        book_depth_->askCountToLevel(max_depth_);
+            current_depth = book_levels_->countToLevel(false, max_depth_) + 
+                        book_levels_->countToLevel(true, max_depth_);
         } else {
-            current_depth = book_depth_->bidSizeToLevel(max_depth_) + 
-                        book_depth_->askSizeToLevel(max_depth_);
+            current_depth = book_levels_->sizeToLevel(false, max_depth_) + 
+                        book_levels_->sizeToLevel(true, max_depth_);
         }
 
         if ( unlikely(status_==StatusCode::INIT) )
@@ -38,7 +38,7 @@ struct LowLiquidity : public ValueNode {
     SERIALIZE(LowLiquidity, symbol_, max_depth_, use_counts_, trigger_fraction_, ema_tick_length_);
 
     RawMarketData* market_data_;
-    BookDepth* book_depth_;
+    BookLevels* book_levels_;
     double depth_ema_;
 
     std::string symbol_;
@@ -57,9 +57,9 @@ struct LowLiquidity : public ValueNode {
           trigger_fraction_(trigger_fraction),
           ema_tick_length_(ema_tick_length) {
         assert(trigger_fraction < 1);
-        book_depth_ = g->add<BookDepth>(g->add<RawMarketData>(symbol_));
-        setParent(book_depth_);
-        setClock(book_depth_);
+        book_levels_ = g->add<BookLevels>(g->add<RawMarketData>(symbol_));
+        setParent(book_levels_);
+        setClock(book_levels_);
     }
 };
 
@@ -132,6 +132,8 @@ struct WideSpread : public ValueNode {
         status_ = StatusCode::OK;
     }
  
+    bool stateless() const override { return true; }
+
     SERIALIZE(WideSpread, symbol_, wide_ticks_);
 
     std::string symbol_;
@@ -230,8 +232,9 @@ struct SafeUpdateFailed : public ValueNode {
         for (auto rmd_ : rmds_ ) {
             if (not rmd_->safeUpdate()) {
                 value_ = true;
-                failed_symbol_ = rmd_->symbol();
-                LOG_INFO() << "FAILED safeUpdate: " << failed_symbol_ << " bid: " << rmd_->bidPrice() << " ask: " << rmd_->askPrice() << " ticksize: " << rmd_->tickSize()
+                failed_ = rmd_;
+                AllocationTracker::Pause pause;
+                LOG_INFO() << "FAILED safeUpdate: " << rmd_->symbol() << " bid: " << rmd_->bidPrice() << " ask: " << rmd_->askPrice() << " ticksize: " << rmd_->tickSize()
                            << " bidSize: " << rmd_->bidSize() << " askSize: " <<   rmd_->askSize() 
                            << " bidNumOrders: " << rmd_->bidNumOrders() << " askNumOrders: " <<   rmd_->askNumOrders();
                 return;
@@ -240,8 +243,8 @@ struct SafeUpdateFailed : public ValueNode {
     }
  
     std::string failedSymbol() {
-        if (value_ == true)
-            return failed_symbol_;
+        if (value_ == true and failed_)
+            return failed_->symbol();
         return "";
     }
 
@@ -249,8 +252,8 @@ struct SafeUpdateFailed : public ValueNode {
 
     Theo* valuation_;
     RawMarketData* market_data_;
-    std::set<RawMarketData*> rmds_;
-    std::string failed_symbol_;
+    std::vector<RawMarketData*> rmds_;
+    RawMarketData* failed_{nullptr}; //not the symbol string, to keep compute() allocation free
 
     protected:
     SafeUpdateFailed(Graph* g, Theo* valuation) 
@@ -359,6 +362,8 @@ struct BadMarkupCount : public ValueNode {
         status_ = StatusCode::OK;
     }
 
+    bool stateless() const override { return true; }
+
     SERIALIZE(BadMarkupCount, order_logic_name_, markup_horizon_, decay_pct_, threshold_, buffer_size_);
     
     protected:
@@ -0,0 +1,131 @@
+#include "model/replay.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+//File layout, all little endian:
+//    char[4]  magic "MRPL"
+//    uint32   version
+//    uint32   number of symbols
+//    per symbol: uint16 length, then the characters
+//    zero padding up to a multiple of 8 bytes
+//    ReplayRecord[] up to the end of the file
+namespace {
+constexpr char magic[4] = {'M', 'R', 'P', 'L'};
+constexpr uint32_t version = 1;
+}
+
+ReplayWriter::ReplayWriter(std::string const& fileName)
+    : file_(fileName, std::ios::out | std::ios::binary | std::ios::trunc) {
+    if(not file_)
+        throw std::runtime_error("ReplayWriter: cannot open " + fileName);
+}
+
+uint16_t ReplayWriter::addSymbol(std::string const& symbol) {
+    if(headerWritten_)
+        throw std::logic_error("ReplayWriter::addSymbol: records already written");
+    for(size_t i=0; i<symbols_.size(); ++i)
+        if(symbols_[i] == symbol)
+            return i;
+    symbols_.push_back(symbol);
+    return symbols_.size() - 1;
+}
+
+void ReplayWriter::writeHeader() {
+    uint32_t nSymbols = symbols_.size();
+    file_.write(magic, sizeof(magic));
+    file_.write(reinterpret_cast<char const*>(&version), sizeof(version));
+    file_.write(reinterpret_cast<char const*>(&nSymbols), sizeof(nSymbols));
+    size_t offset = sizeof(magic) + sizeof(version) + sizeof(nSymbols);
+    for(auto const& symbol : symbols_) {
+        uint16_t length = symbol.size();
+        file_.write(reinterpret_cast<char const*>(&length), sizeof(length));
+        file_.write(symbol.data(), length);
+        offset += sizeof(length) + length;
+    }
+    char const padding[8] = {};
+    file_.write(padding, (8 - offset % 8) % 8);
+    headerWritten_ = true;
+}
+
+void ReplayWriter::write(ReplayRecord const& record) {
+    if(not headerWritten_)
+        writeHeader();
+    if(record.type != ReplayRecord::Type::PRIVATE and record.symbol >= symbols_.size())
+        throw std::logic_error("ReplayWriter::write: unknown symbol");
+    file_.write(reinterpret_cast<char const*>(&record), sizeof(record));
+}
+
+void ReplayWriter::close() {
+    if(not file_.is_open())
+        return;
+    if(not headerWritten_)
+        writeHeader();
+    file_.close();
+}
+
+ReplayReader::ReplayReader(std::string const& fileName) {
+    int fd = ::open(fileName.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("ReplayReader: cannot open " + fileName);
+    struct stat st;
+    if(::fstat(fd, &st) != 0 or st.st_size == 0) {
+        ::close(fd);
+        throw std::runtime_error("ReplayReader: cannot read " + fileName);
+    }
+    mapSize_ = st.st_size;
+    map_ = ::mmap(nullptr, mapSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(map_ == MAP_FAILED) {
+        map_ = nullptr;
+        throw std::runtime_error("ReplayReader: cannot map " + fileName);
+    }
+    ::madvise(map_, mapSize_, MADV_SEQUENTIAL);
+
+    auto data = static_cast<char const*>(map_);
+    size_t offset = 0;
+    auto read = [&](void* out, size_t n) {
+        if(offset + n > mapSize_)
+            throw std::runtime_error("ReplayReader: truncated header in " + fileName);
+        std::memcpy(out, data + offset, n);
+        offset += n;
+    };
+    try {
+        char fileMagic[4];
+        uint32_t fileVersion, nSymbols;
+        read(fileMagic, sizeof(fileMagic));
+        read(&fileVersion, sizeof(fileVersion));
+        read(&nSymbols, sizeof(nSymbols));
+        if(std::memcmp(fileMagic, magic, sizeof(magic)) != 0 or fileVersion != version)
+            throw std::runtime_error("ReplayReader: not a replay file: " + fileName);
+        for(uint32_t i=0; i<nSymbols; ++i) {
+            uint16_t length;
+            read(&length, sizeof(length));
+            symbols_.emplace_back(length, '\0');
+            read(&symbols_.back()[0], length);
+        }
+        offset += (8 - offset % 8) % 8;
+        if(offset > mapSize_ or (mapSize_ - offset) % sizeof(ReplayRecord) != 0)
+            throw std::runtime_error("ReplayReader: truncated records in " + fileName);
+    } catch(...) {
+        ::munmap(map_, mapSize_);
+        throw;
+    }
+    records_ = reinterpret_cast<ReplayRecord const*>(data + offset);
+    nRecords_ = (mapSize_ - offset) / sizeof(ReplayRecord);
+    for(auto const& record : *this)
+        if(record.type != ReplayRecord::Type::PRIVATE and record.symbol >= symbols_.size()) {
+            ::munmap(map_, mapSize_);
+            throw std::runtime_error("ReplayReader: unknown symbol in " + fileName);
+        }
+}
+
+ReplayReader::~ReplayReader() {
+    if(map_)
+        ::munmap(map_, mapSize_);
+}
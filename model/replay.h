@@ -0,0 +1,162 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "model/market_data.h"
+
+//Offline replay of recorded market data through a model graph.
+//
+//A replay file is a header, a symbol table, and a flat array of fixed-size
+//ReplayRecords in receive-time order.  Book records are applied to a per
+//symbol md::Book, trades are collected, and when a record is flagged as the
+//end of a packet the handler is asked to fire that symbol's source.  Time only
+//moves when the handler advances the simulated clock, so a run is fully
+//deterministic and goes as fast as the graph can fire.
+
+struct ReplayRecord {
+    enum class Type : uint8_t { ADD, CANCEL, TRADE, PRIVATE };
+    static constexpr uint8_t ASK = 1;
+    static constexpr uint8_t END_OF_PACKET = 2;
+
+    int64_t exchangeNs;
+    int64_t receiveNs;
+    uint64_t orderId;  //PRIVATE: caller defined message id
+    double price;
+    int32_t size;
+    uint16_t symbol;   //index into the symbol table
+    Type type;
+    uint8_t flags;
+
+    Side side() const { return (flags & ASK) ? Side::Ask : Side::Bid; }
+    bool endOfPacket() const { return flags & END_OF_PACKET; }
+};
+static_assert(sizeof(ReplayRecord) == 40, "ReplayRecord is a file format");
+
+struct ReplayTrade {
+    int32_t size;
+    double price;
+};
+
+//Book and pending trades of one symbol, as seen by ReplayEngine handlers.
+struct ReplaySymbol {
+    std::string name;
+    md::Book book;
+    std::vector<ReplayTrade> trades; //since the last packet
+    ReplayRecord const* last{nullptr}; //record that ended the packet
+};
+
+//Symbols must all be added before the first record is written.
+struct ReplayWriter {
+    explicit ReplayWriter(std::string const& fileName);
+    ~ReplayWriter() { close(); }
+
+    uint16_t addSymbol(std::string const& symbol);
+    void write(ReplayRecord const& record);
+    void close();
+
+    private:
+    void writeHeader();
+
+    std::ofstream file_;
+    std::vector<std::string> symbols_;
+    bool headerWritten_{false};
+};
+
+//Maps a replay file read-only; records are read in place.
+struct ReplayReader {
+    explicit ReplayReader(std::string const& fileName);
+    ~ReplayReader();
+    ReplayReader(ReplayReader const&) = delete;
+
+    std::vector<std::string> const& symbols() const { return symbols_; }
+    ReplayRecord const* begin() const { return records_; }
+    ReplayRecord const* end() const { return records_ + nRecords_; }
+    size_t size() const { return nRecords_; }
+
+    private:
+    void* map_{nullptr};
+    size_t mapSize_{0};
+    std::vector<std::string> symbols_;
+    ReplayRecord const* records_{nullptr};
+    size_t nRecords_{0};
+};
+
+struct ReplayStats {
+    uint64_t records{0};
+    uint64_t packets{0};
+    std::chrono::nanoseconds wallTime{0};
+};
+
+//Handler requirements:
+//    void advanceClock(std::chrono::nanoseconds dt);  //move the simulated clock;
+//                                                     //the first record is time zero
+//
+//run() throws std::runtime_error on a record received before the one ahead of it.
+//    void onPacket(uint16_t symbol, ReplaySymbol& state); //fire the symbol's source
+//    void onPrivate(ReplayRecord const& record);
+struct ReplayEngine {
+    explicit ReplayEngine(ReplayReader const& reader) : reader_(reader) {
+        for(auto const& name : reader.symbols()) {
+            symbols_.emplace_back();
+            symbols_.back().name = name;
+        }
+    }
+
+    ReplaySymbol& symbol(uint16_t i) { return symbols_[i]; }
+
+    template <typename Handler>
+    ReplayStats run(Handler& handler) {
+        ReplayStats stats;
+        auto wallStart = std::chrono::steady_clock::now();
+        for(auto const& record : reader_) {
+            if(not started_) {
+                started_ = true;
+                nowNs_ = record.receiveNs;
+            } else if(record.receiveNs > nowNs_) {
+                handler.advanceClock(std::chrono::nanoseconds(record.receiveNs - nowNs_));
+                nowNs_ = record.receiveNs;
+            } else if(record.receiveNs < nowNs_) {
+                throw std::runtime_error("ReplayEngine::run: record " + std::to_string(stats.records)
+                                         + " goes back in time");
+            }
+            ++stats.records;
+            if(record.type == ReplayRecord::Type::PRIVATE) {
+                handler.onPrivate(record);
+                continue;
+            }
+            auto& state = symbols_[record.symbol];
+            switch(record.type) {
+                case ReplayRecord::Type::ADD:
+                    state.book.insert(md::Order{record.orderId, record.side(), record.size, record.price});
+                    break;
+                case ReplayRecord::Type::CANCEL:
+                    state.book.cancel(record.orderId);
+                    break;
+                case ReplayRecord::Type::TRADE:
+                    state.trades.push_back(ReplayTrade{record.size, record.price});
+                    break;
+                default:
+                    break;
+            }
+            if(record.endOfPacket()) {
+                state.last = &record;
+                handler.onPacket(record.symbol, state);
+                state.trades.clear();
+                ++stats.packets;
+            }
+        }
+        stats.wallTime = std::chrono::steady_clock::now() - wallStart;
+        return stats;
+    }
+
+    private:
+    ReplayReader const& reader_;
+    std::vector<ReplaySymbol> symbols_;
+    bool started_{false};
+    int64_t nowNs_{0};
+};
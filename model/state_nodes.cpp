@@ -2,6 +2,12 @@
 
 NODE_FACTORY_ADD(AbsoluteVariation);
 NODE_FACTORY_ADD(AccumRefreshed);
+NODE_FACTORY_ADD(DecayedCorr);
+NODE_FACTORY_ADD(DecayedCov);
+NODE_FACTORY_ADD(DecayedCovMatrix);
+NODE_FACTORY_ADD(DecayedSum);
+NODE_FACTORY_ADD(DecayedSumBank);
+NODE_FACTORY_ADD(HYCov);
 NODE_FACTORY_ADD(HYTimeCov);
 NODE_FACTORY_ADD(JointTradeAggression);
 NODE_FACTORY_ADD(Latency);
@@ -1,5 +1,8 @@
 #pragma once
 #include "accumulators.h"
+#include "decay.h"
+#include "decayed_cov_matrix.h"
+#include "decayed_sum_bank.h"
 #include "ema.h"
 #include "graph.h"
 #include "iceberg.h"
@@ -29,7 +32,7 @@ struct AccumRefreshed : public ValueNode {
           market_data_(market_data) {
         auto size_refreshed = g->add<SizeRefreshed>(market_data->symbol());
         trade_direction_ = g->add<TradeDirection>(market_data);
-        recent_refreshes_ = g->add<TimeDecayedSum>(size_refreshed, size_refreshed->getClock(), length_in_nanos);
+        recent_refreshes_ = g->add<DecayedSum>(g->add<DecayedSumBank>(size_refreshed, size_refreshed->getClock()), length_in_nanos);
         setParents(recent_refreshes_, trade_direction_);
         setClock(g->add<OnTrade>(market_data));
     }
@@ -90,7 +93,7 @@ struct TradeAggression : public ValueNode {
         trade_direction_ = g->add<TradeDirection>(market_data);
         auto signed_trade_cost = g->add<SignedTradeCost>(theo);
         auto padded_signed_trade_cost = g->add<Pad>(signed_trade_cost, market_data, 0); 
-        auto recent_cost = g->add<TimeDecayedSum>(padded_signed_trade_cost, market_data, length_in_nanos);
+        auto recent_cost = g->add<DecayedSum>(g->add<DecayedSumBank>(padded_signed_trade_cost, market_data), length_in_nanos);
         last_recent_cost_ = g->add<Last>(recent_cost);
         setParents(trade_direction_, last_recent_cost_);
         setClock(market_data);
@@ -129,7 +132,7 @@ struct JointTradeAggression : public ValueNode {
         auto signed_trade_cost = g->add<Join>(signed_trade_cost_vec);
         auto padded_signed_trade_cost_ = g->add<Pad>(signed_trade_cost, update_clock, 0); 
         trade_direction_ = g->add<Join>(trade_direction_vec);
-        recent_cost_= g->add<TimeDecayedSum>(padded_signed_trade_cost_, update_clock, length_in_nanos);
+        recent_cost_= g->add<DecayedSum>(g->add<DecayedSumBank>(padded_signed_trade_cost_, update_clock), length_in_nanos);
         setParents(trade_direction_, recent_cost_);
         setClock(update_clock);
     }
@@ -184,11 +187,11 @@ struct TradeCostLeadingCov : public ValueNode {
 
         auto traded_signed_trade_cost = g->add<SignedTradeCost>(traded_theo);
         auto traded_padded_signed_trade_cost = g->add<Pad>(traded_signed_trade_cost, joint_clock, 0); 
-        traded_cost_ = g->add<TimeDecayedSum>(traded_padded_signed_trade_cost, joint_clock, cost_length_in_nanos);
+        traded_cost_ = g->add<DecayedSum>(g->add<DecayedSumBank>(traded_padded_signed_trade_cost, joint_clock), cost_length_in_nanos);
  
         auto ref_signed_trade_cost = g->add<SignedTradeCost>(ref_theo);
         auto ref_padded_signed_trade_cost = g->add<Pad>(ref_signed_trade_cost, joint_clock, 0); 
-        ref_cost_ = g->add<TimeDecayedSum>(ref_padded_signed_trade_cost, joint_clock, cost_length_in_nanos);
+        ref_cost_ = g->add<DecayedSum>(g->add<DecayedSumBank>(ref_padded_signed_trade_cost, joint_clock), cost_length_in_nanos);
 
         cov_ema_.setLength(corr_decay_length);
         traded_var_ema_.setLength(corr_decay_length);
@@ -209,9 +212,8 @@ struct AbsoluteVariation : public ValueNode {
         Int64 current_time = getGraph()->nSecUptime(); 
         double elapsed_nanos = current_time - last_decay_time_;
         if ( elapsed_nanos < 1 ) elapsed_nanos = 1;
-        double decay_pct = std::max(0.0, 1.0 - elapsed_nanos / length_in_nanos_.count());
-        value_ *= decay_pct;
-        last_decay_time_ = getGraph()->nSecUptime(); 
+        decay_.apply(elapsed_nanos, value_);
+        last_decay_time_ = current_time;
     }
 
     void compute() override {
@@ -226,21 +228,26 @@ struct AbsoluteVariation : public ValueNode {
     }
 
     std::string defaultName() const override { 
-        return getClassName() + node_->getName() + getDurationString(length_in_nanos_);
+        return getClassName() + node_->getName() + getDurationString(length_in_nanos_) + Decay::nameSuffix(decay_kind_);
     }
 
-    SERIALIZE(AbsoluteVariation, node_, length_in_nanos_);
+    SERIALIZE(AbsoluteVariation, node_, length_in_nanos_, decay_kind_);
     
     ValueNode* node_;
     std::chrono::nanoseconds length_in_nanos_;
+    Decay::Kind decay_kind_;
+    Decay decay_;
     Int64 last_decay_time_;
     double lag_node_value_;
 
     protected:
-    AbsoluteVariation(Graph* g, ValueNode* node, std::chrono::nanoseconds length_in_nanos) 
+    AbsoluteVariation(Graph* g, ValueNode* node, std::chrono::nanoseconds length_in_nanos,
+                      Decay::Kind decay_kind=Decay::Kind::LINEAR) 
         : ValueNode(g, Units::NONE),  
           node_(node),
-          length_in_nanos_(length_in_nanos) {
+          length_in_nanos_(length_in_nanos),
+          decay_kind_(decay_kind),
+          decay_(length_in_nanos, decay_kind) {
         value_ = 0;
 
         setParents(node_);
@@ -296,10 +303,7 @@ struct RelativePacketRate: public ValueNode {
             auto current_exchange_time_ = currentExchangeTime();
             auto elapsed = current_exchange_time_ - last_exchange_time_;
             double nanos_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(); 
-            double decay_factor = std::max(0.0, 1.0 - nanos_elapsed/ems_length_.count());
-
-            base_ems_ *= decay_factor;
-            ref_ems_ *= decay_factor;
+            decay_.apply(nanos_elapsed, base_ems_, ref_ems_);
             if (market_data_->ticked())
                 base_ems_ += 1; 
             else
@@ -319,23 +323,29 @@ struct RelativePacketRate: public ValueNode {
         std::string ref_syms;
         for (auto ref_sym : ref_symbols_)
             ref_syms += getShortSymbol(ref_sym);
-        return (getClassName() + market_data_->shortSymbol() + ref_syms + getDurationString(ems_length_));
+        return (getClassName() + market_data_->shortSymbol() + ref_syms + getDurationString(ems_length_)
+              + Decay::nameSuffix(decay_kind_));
     }
 
-    SERIALIZE(RelativePacketRate, market_data_, ref_symbols_, ems_length_);
+    SERIALIZE(RelativePacketRate, market_data_, ref_symbols_, ems_length_, decay_kind_);
 
     std::vector<std::string> ref_symbols_;
     std::chrono::nanoseconds ems_length_;
+    Decay::Kind decay_kind_;
+    Decay decay_;
     double base_ems_{0}, ref_ems_{0};
     vplat_clock::time_point last_exchange_time_;
     MarketData* market_data_;
     
     RelativePacketRate(Graph* g, MarketData* market_data,
                        std::vector<std::string> ref_symbols, 
-                       std::chrono::nanoseconds ems_length)
+                       std::chrono::nanoseconds ems_length,
+                       Decay::Kind decay_kind=Decay::Kind::LINEAR)
         : ValueNode(g, Units::NONE),
           ref_symbols_(ref_symbols),
           ems_length_(ems_length),
+          decay_kind_(decay_kind),
+          decay_(ems_length, decay_kind),
           market_data_(market_data) {
 
         {
@@ -370,7 +380,7 @@ struct PacketRate: public ValueNode {
             double nanos_elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(); 
             if (nanos_elapsed>0) {
                 last_exchange_time_ = current_exchange_time;
-                value_ *= std::max(0.0, 1.0 - nanos_elapsed/ems_length_.count());
+                decay_.apply(nanos_elapsed, value_);
             }
             if (market_data_->ticked()) value_ += 1;
         }
@@ -378,27 +388,33 @@ struct PacketRate: public ValueNode {
     }
 
     std::string defaultName() const override { 
-        return (getClassName() + market_data_->shortSymbol() + getDurationString(ems_length_));
+        return (getClassName() + market_data_->shortSymbol() + getDurationString(ems_length_)
+              + Decay::nameSuffix(decay_kind_));
     }
 
-    SERIALIZE(PacketRate, market_data_, decay_clock_, ems_length_);
+    SERIALIZE(PacketRate, market_data_, decay_clock_, ems_length_, decay_kind_);
 
     ClockNode* decay_clock_;
     std::chrono::nanoseconds ems_length_;
+    Decay::Kind decay_kind_;
+    Decay decay_;
     vplat_clock::time_point last_exchange_time_;
     MarketData* market_data_;
     
-    PacketRate(Graph* g, MarketData* market_data, ClockNode* decay_clock, std::chrono::nanoseconds ems_length)
+    PacketRate(Graph* g, MarketData* market_data, ClockNode* decay_clock, std::chrono::nanoseconds ems_length,
+               Decay::Kind decay_kind=Decay::Kind::LINEAR)
         : ValueNode(g, Units::NONE),
           decay_clock_(decay_clock),
           ems_length_(ems_length),
+          decay_kind_(decay_kind),
+          decay_(ems_length, decay_kind),
           market_data_(market_data) {
         setClock(market_data, decay_clock);
     }
 };
 
-//TODO(mshivers): Write a Hayashi Yoshida covariance node with Tick decay.  Tick is sometimes significant when Time
-//isn't
+//Time-decayed Hayashi Yoshida covariance of strictly asynchronous signals.  See HYCov for tick decay, and for
+//signals that share a source clock.
 struct HYTimeCov : public ValueNode {
     void updateValue() {
         if ( sig1_->ticked() ) {
@@ -422,9 +438,8 @@ struct HYTimeCov : public ValueNode {
         Int64 current_time = getGraph()->nSecUptime(); 
         double elapsed_nanos = current_time - last_decay_time_;
         if ( elapsed_nanos < 1 ) elapsed_nanos = 1;
-        double decay_pct = std::max(0.0, 1.0 - elapsed_nanos / length_in_nanos_.count());
-        value_ *= decay_pct;
-        last_decay_time_ = getGraph()->nSecUptime(); 
+        decay_.apply(elapsed_nanos, value_);
+        last_decay_time_ = current_time;
     }
 
     void compute() override {
@@ -442,13 +457,15 @@ struct HYTimeCov : public ValueNode {
 
     std::string defaultName() const override { 
         return ( getClassName() + sig1_->defaultName() + sig2_->defaultName() 
-               + getDurationString(length_in_nanos_) ); 
+               + getDurationString(length_in_nanos_) + Decay::nameSuffix(decay_kind_) ); 
     }
 
-    SERIALIZE(HYTimeCov, sig1_, sig2_, length_in_nanos_, decay_clock_);
+    SERIALIZE(HYTimeCov, sig1_, sig2_, length_in_nanos_, decay_clock_, decay_kind_);
     
     ValueNode *sig1_, *sig2_, *last_ticked_;
     std::chrono::nanoseconds length_in_nanos_;
+    Decay::Kind decay_kind_;
+    Decay decay_;
     ClockNode* decay_clock_;
     Int64 last_decay_time_;
     double lag1_, lag2_;
@@ -456,11 +473,14 @@ struct HYTimeCov : public ValueNode {
 
     protected:
     HYTimeCov(Graph* g, ValueNode* sig1, ValueNode* sig2, 
-        std::chrono::nanoseconds length_in_nanos, ClockNode* decay_clock) 
+        std::chrono::nanoseconds length_in_nanos, ClockNode* decay_clock,
+        Decay::Kind decay_kind=Decay::Kind::LINEAR) 
         : ValueNode(g, Units::NONE),
           sig1_(sig1),
           sig2_(sig2),
           length_in_nanos_(length_in_nanos),
+          decay_kind_(decay_kind),
+          decay_(length_in_nanos, decay_kind),
           decay_clock_(decay_clock){
         assert(!hasCommonSourceClock(sig1, sig2));  //calculations assume strictly asyncronous.
         value_ = 0;
@@ -469,6 +489,91 @@ struct HYTimeCov : public ValueNode {
     }
 };
 
+//Hayashi Yoshida covariance with time decay, tick decay, or both, that also works for signals that tick together.
+//
+//Moves are sampled in refresh time: each signal's move runs from its lag until both signals have ticked since the
+//last refresh, then the product of the two moves is added and both lags reset.  Signals that always tick together
+//refresh on every tick, which is the realized covariance; strictly asynchronous signals give the refresh-time HY
+//estimate.  The refresh is applied with 0/1 weights, so there's no branch on which signal ticked.
+//
+//On every fire value_ decays by decay_ over the elapsed time, unless length_in_nanos is zero, and on each tick of
+//decay_clock by (length_in_ticks-1)/length_in_ticks, unless length_in_ticks is zero.
+struct HYCov : public ValueNode {
+    void decayValue(int64_t current_time) {
+        double factor = decay_clock_->ticked() ? tick_factor_ : 1.0;
+        if ( length_in_nanos_.count() > 0 ) {
+            double elapsed_nanos = current_time - last_decay_time_;
+            if ( elapsed_nanos < 1 ) elapsed_nanos = 1;
+            factor *= decay_.factor(elapsed_nanos);
+        }
+        value_ *= factor;
+    }
+
+    void updateValue() {
+        dx1_ = sig1_->heldValue() - lag1_;
+        dx2_ = sig2_->heldValue() - lag2_;
+        fresh1_ = std::max(fresh1_, double(sig1_->ticked()));
+        fresh2_ = std::max(fresh2_, double(sig2_->ticked()));
+        double refresh = fresh1_ * fresh2_;
+        value_ += refresh * dx1_ * dx2_;
+        lag1_ += refresh * dx1_;
+        lag2_ += refresh * dx2_;
+        fresh1_ -= refresh;
+        fresh2_ -= refresh;
+    }
+
+    void compute() override {
+        int64_t current_time = getGraph()->nSecUptime();
+        if ( unlikely(status_==StatusCode::INIT) ) {
+            lag1_ = sig1_->heldValue();
+            lag2_ = sig2_->heldValue();
+        } else {
+            decayValue(current_time);
+            updateValue();
+        }
+        last_decay_time_ = current_time;
+        status_ = StatusCode::OK;
+    }
+
+    std::string defaultName() const override { 
+        return ( getClassName() + sig1_->defaultName() + sig2_->defaultName() 
+               + getDurationString(length_in_nanos_) + Decay::nameSuffix(decay_kind_)
+               + std::to_string((int)length_in_ticks_) + "t" ); 
+    }
+
+    SERIALIZE(HYCov, sig1_, sig2_, length_in_nanos_, length_in_ticks_, decay_clock_, decay_kind_);
+    
+    ValueNode *sig1_, *sig2_;
+    std::chrono::nanoseconds length_in_nanos_;
+    double length_in_ticks_;
+    ClockNode* decay_clock_;
+    Decay::Kind decay_kind_;
+    Decay decay_;
+    double tick_factor_;
+    Int64 last_decay_time_;
+    double lag1_, lag2_;
+    double dx1_{0}, dx2_{0};
+    double fresh1_{0}, fresh2_{0}; //1 if the signal has ticked since the last refresh
+
+    protected:
+    HYCov(Graph* g, ValueNode* sig1, ValueNode* sig2, std::chrono::nanoseconds length_in_nanos, 
+          double length_in_ticks, ClockNode* decay_clock, Decay::Kind decay_kind=Decay::Kind::LINEAR) 
+        : ValueNode(g, Units::NONE),
+          sig1_(sig1),
+          sig2_(sig2),
+          length_in_nanos_(length_in_nanos),
+          length_in_ticks_(length_in_ticks),
+          decay_clock_(decay_clock),
+          decay_kind_(decay_kind),
+          decay_(length_in_nanos.count() > 0 ? length_in_nanos : std::chrono::nanoseconds(1), decay_kind),
+          tick_factor_(length_in_ticks > 0 ? (length_in_ticks - 1) / length_in_ticks : 1.0) {
+        assert(length_in_ticks == 0 or length_in_ticks >= 1);
+        value_ = 0;
+        setParents(sig1, sig2);
+        setClock(sig1, sig2, decay_clock);
+    }
+};
+
 struct QuadraticVariation : public ValueNode {
     void updateValue() {
         dx_ = sig_->heldValue() - lag_;
@@ -480,9 +585,8 @@ struct QuadraticVariation : public ValueNode {
         Int64 current_time = getGraph()->nSecUptime(); 
         double elapsed_nanos = current_time - last_decay_time_;
         if ( elapsed_nanos < 1 ) elapsed_nanos = 1;
-        double decay_pct = std::max(0.0, 1.0 - elapsed_nanos / length_in_nanos_.count());
-        value_ *= decay_pct;
-        last_decay_time_ = getGraph()->nSecUptime(); 
+        decay_.apply(elapsed_nanos, value_);
+        last_decay_time_ = current_time;
     }
 
     void compute() override {
@@ -497,23 +601,29 @@ struct QuadraticVariation : public ValueNode {
     }
 
     std::string defaultName() const override { 
-        return (getClassName() + sig_->defaultName() + getDurationString(length_in_nanos_)); 
+        return (getClassName() + sig_->defaultName() + getDurationString(length_in_nanos_)
+              + Decay::nameSuffix(decay_kind_)); 
     }
 
-    SERIALIZE(QuadraticVariation, sig_, length_in_nanos_, decay_clock_);
+    SERIALIZE(QuadraticVariation, sig_, length_in_nanos_, decay_clock_, decay_kind_);
     
     ValueNode* sig_;
     std::chrono::nanoseconds length_in_nanos_;
+    Decay::Kind decay_kind_;
+    Decay decay_;
     ClockNode* decay_clock_;
     Int64 last_decay_time_;
     double lag_;
     double dx_;
 
     protected:
-    QuadraticVariation(Graph* g, ValueNode* sig, std::chrono::nanoseconds length_in_nanos, ClockNode* decay_clock) 
+    QuadraticVariation(Graph* g, ValueNode* sig, std::chrono::nanoseconds length_in_nanos, ClockNode* decay_clock,
+                       Decay::Kind decay_kind=Decay::Kind::LINEAR) 
         : ValueNode(g, Units::NONE),
           sig_(sig),
           length_in_nanos_(length_in_nanos),
+          decay_kind_(decay_kind),
+          decay_(length_in_nanos, decay_kind),
           decay_clock_(decay_clock){
         value_ = 0;
         setParents(sig);
@@ -528,9 +638,8 @@ struct VWAPCov : public ValueNode {
         Int64 current_time = getGraph()->nSecUptime(); 
         double elapsed_nanos = current_time - last_decay_time_;
         if ( elapsed_nanos < 1 ) elapsed_nanos = 1;
-        double decay_pct = std::max(0.0, 1.0 - elapsed_nanos / cov_decay_length_.count());
-        value_ *= decay_pct;
-        last_decay_time_ = getGraph()->nSecUptime(); 
+        decay_.apply(elapsed_nanos, value_);
+        last_decay_time_ = current_time;
     }
 
     void compute() override {
@@ -549,10 +658,10 @@ struct VWAPCov : public ValueNode {
     std::string defaultName() const override { 
         return (getClassName() + base_theo_->defaultName() + ref_theo_->defaultName() 
               + "VWAP" + getDurationString(nano_vwap_length_) 
-              + "Cov" + getDurationString(cov_decay_length_) );
+              + "Cov" + getDurationString(cov_decay_length_) + Decay::nameSuffix(decay_kind_) );
     }
 
-    SERIALIZE(VWAPCov, base_theo_, ref_theo_, nano_vwap_length_, cov_decay_length_);
+    SERIALIZE(VWAPCov, base_theo_, ref_theo_, nano_vwap_length_, cov_decay_length_, decay_kind_);
 
     Theo* base_theo_;
     Theo* ref_theo_;
@@ -560,17 +669,22 @@ struct VWAPCov : public ValueNode {
     ValueNode* base_vwap_;
     std::chrono::nanoseconds nano_vwap_length_;
     std::chrono::nanoseconds cov_decay_length_;
+    Decay::Kind decay_kind_;
+    Decay decay_;
     Int64 last_decay_time_;
 
     protected:
     VWAPCov(Graph* g, Theo* base_theo, Theo* ref_theo, 
             std::chrono::nanoseconds nano_vwap_length,
-            std::chrono::nanoseconds cov_decay_length) 
+            std::chrono::nanoseconds cov_decay_length,
+            Decay::Kind decay_kind=Decay::Kind::LINEAR) 
         : ValueNode(g, Units::NONE),  
           base_theo_(base_theo), 
           ref_theo_(ref_theo), 
           nano_vwap_length_(nano_vwap_length),
-          cov_decay_length_(cov_decay_length) {
+          cov_decay_length_(cov_decay_length),
+          decay_kind_(decay_kind),
+          decay_(cov_decay_length, decay_kind) {
         base_vwap_ = g->add<TimeVWAP>(base_theo->marketData(), nano_vwap_length);
         ref_vwap_ = g->add<TimeVWAP>(ref_theo->marketData(), nano_vwap_length);
         setParents(base_vwap_, ref_vwap_, base_theo, ref_theo);
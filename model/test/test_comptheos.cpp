@@ -95,7 +95,160 @@ TEST_F(test_comptheos, comptheo) {
     EXPECT_NEAR(comp_theo->value(), 10.625, .00001);
 }
 
+TEST_F(test_comptheos, comp_theo_bank) {
+    auto base = g->add<Midpt>(btec);
+    auto ref = g->add<WeightAve>(espeed);
+
+    //every vol mult against the same ref ema shares one bank
+    auto ct_short = g->add<TickCompTheo>(base, ref, 2, 1.0);
+    auto ct_short_2vm = g->add<TickCompTheo>(base, ref, 2, 2.0);
+    auto ct_long = g->add<TickCompTheo>(base, ref, 10, 0.5);
+    ASSERT_TRUE((ct_short));
+    ASSERT_EQ(ct_short->bank_, ct_short_2vm->bank_);
+    ASSERT_NE(ct_short->bank_, ct_long->bank_);
+    ASSERT_NE(ct_short->slot_, ct_short_2vm->slot_);
+    ASSERT_EQ(ct_short->bank_->addComp(2.0), ct_short_2vm->slot_);
+
+    espeed_book.insert(md::Order{1001, Side::Bid, 300, 10.0});
+    espeed_book.insert(md::Order{1002, Side::Ask, 100, 11.0});
+    espeed->fireBookChange(espeed_msg);
+    btec_book.insert(md::Order{1001, Side::Bid, 100, 10.0});
+    btec_book.insert(md::Order{1002, Side::Ask, 200, 11.0});
+    btec->fireBookChange(btec_msg);
+
+    //move the ref away from its emas
+    espeed_book.insert(md::Order{1003, Side::Bid, 300, 10.5});
+    espeed->fireBookChange(espeed_msg);
+
+    for ( auto ct : {ct_short, ct_short_2vm, ct_long} ) {
+        double ratio = ct->ref_theo_->heldValue() / ct->ref_ema_->heldValue();
+        EXPECT_NE(ratio, 1.0);
+        EXPECT_DOUBLE_EQ(ct->value(), ct->base_ema_->heldValue() * std::pow(ratio, ct->vol_mult_));
+    }
+}
+
+TEST_F(test_comptheos, comp_theo_bank_untraded_vwap) {
+    auto base_md = g->add<MockEventSourceMarketData>("BTEC:US5Y");
+    auto ref_md = g->add<MockEventSourceMarketData>("BTEC:US10Y");
+    auto base = g->add<Midpt>(base_md);
+    auto ref = g->add<Midpt>(ref_md);
+
+    auto ema_ct = g->add<TimeCompTheo>(base, ref, seconds{10}, 1.0);
+    auto vwap_ct = g->add<TimeVWAPCompTheo>(base_md, ref, seconds{10}, 1.0);
+    ASSERT_NE(ema_ct->bank_, vwap_ct->bank_);
+
+    base_book.insert(md::Order{1001, Side::Bid, 100, 100.0});
+    base_book.insert(md::Order{2001, Side::Ask, 100, 102.0});
+    base_md->fireBookChange(base_msg);
+    ref_book.insert(md::Order{1001, Side::Bid, 100, 92.0});
+    ref_book.insert(md::Order{2001, Side::Ask, 100, 94.0});
+    ref_md->fireBookChange(ref_msg);
+
+    //the ref vwap hasn't traded, which mustn't hold up the ema comp theo
+    ASSERT_FALSE(vwap_ct->ref_vwap_->valid());
+    ASSERT_FALSE(vwap_ct->valid());
+    ASSERT_TRUE(ema_ct->bank_->valid());
+    ASSERT_TRUE(ema_ct->valid());
+
+    clock.incrementTime(std::chrono::milliseconds{100});
+    ref_book.insert(md::Order{1002, Side::Bid, 100, 93.0});
+    ref_md->fireBookChange(ref_msg);
+    ASSERT_TRUE(ema_ct->valid());
+    double ratio = ref->heldValue() / ema_ct->ref_ema_->heldValue();
+    EXPECT_DOUBLE_EQ(ema_ct->value(), ema_ct->base_ema_->heldValue() * ratio);
+
+    base_msg.addTrade(MockBookTradeMsg{5, 101});
+    base_md->fireBookChange(base_msg);
+    base_msg.clearTrades();
+    ref_msg.addTrade(MockBookTradeMsg{2, 94});
+    ref_md->fireBookChange(ref_msg);
+    ref_msg.clearTrades();
+    ASSERT_TRUE(vwap_ct->valid());
+    EXPECT_DOUBLE_EQ(vwap_ct->value(), 101 * ref->heldValue() / 94.0);
+    ASSERT_TRUE(ema_ct->valid());
+}
+
+TEST_F(test_comptheos, decayed_mixture) {
+    DecayedMixture mixture;
+    mixture.resize(3);
+    std::vector<double> w(3, 0), x{100, 101, 102};
+    mixture.setValues([&](size_t i) { return x[i]; });
+
+    auto check = [&]() {
+        double weight_sum = 0, weighted_sum = 0;
+        for ( size_t i=0; i<3; ++i ) {
+            EXPECT_NEAR(mixture.weight(i), w[i], 1e-9);
+            weight_sum += w[i];
+            weighted_sum += w[i] * x[i];
+        }
+        EXPECT_NEAR(mixture.weightSum(), weight_sum, 1e-9);
+        EXPECT_NEAR(mixture.weightedSum(), weighted_sum, 1e-7);
+    };
+
+    mixture.addWeight(0, 5);
+    mixture.addWeight(2, 1);
+    w[0] += 5;
+    w[2] += 1;
+    check();
+
+    mixture.decay(0.5);
+    for ( auto& wi : w ) wi *= 0.5;
+    mixture.setValue(2, 103);
+    x[2] = 103;
+    mixture.addWeight(1, 4);
+    w[1] += 4;
+    check();
+
+    //the scale gets folded back into the weights long before it underflows
+    for ( int k=0; k<200; ++k ) {
+        mixture.decay(0.1);
+        mixture.addWeight(k % 3, 1);
+        for ( auto& wi : w ) wi *= 0.1;
+        w[k % 3] += 1;
+    }
+    check();
+
+    //a full decay zeroes every weight
+    mixture.decay(0);
+    std::fill(w.begin(), w.end(), 0);
+    check();
+}
+
 #ifdef REPLAY_BUILD
+TEST_F(test_comptheos, packet_rate_comp_theo_values) {
+    using millis = std::chrono::milliseconds;
+    auto theo = g->add<PacketRateCompTheo>(btec5y, std::vector<MarketData*>{btec}, millis{500}, millis{100});
+    auto comp_theo = theo->comp_theos_[0];
+    //the mixture's value for the ref must be the comp theo's current one
+    auto check = [&]() {
+        EXPECT_NEAR(theo->mixture_.weightedSum(), theo->mixture_.weight(0) * comp_theo->heldValue(), 1e-9);
+    };
+
+    base_book.insert(md::Order{1001, Side::Bid, 100, 99.0});
+    base_book.insert(md::Order{1002, Side::Ask, 100, 101.0});
+    btec5y->fireBookChange(base_msg);
+    ref_book.insert(md::Order{2001, Side::Bid, 100, 105.0});
+    ref_book.insert(md::Order{2002, Side::Ask, 100, 107.0});
+    btec->fireBookChange(ref_msg);
+
+    clock.incrementTime(millis{10});
+    ref_msg.addTrade(MockBookTradeMsg{10, 107});
+    btec->fireBookChange(ref_msg);
+    ref_msg.clearTrades();
+    EXPECT_GT(theo->mixture_.weight(0), 0);
+    check();
+
+    //the comp theo follows the base while its ref is quiet
+    uint64_t order_id = 1003;
+    for ( double bid : {99.5, 100.0, 99.25} ) {
+        clock.incrementTime(millis{10});
+        base_book.insert(md::Order{order_id++, Side::Bid, 100, bid});
+        btec5y->fireBookChange(base_msg);
+        EXPECT_FALSE(btec->ticked());
+        check();
+    }
+}
+
 TEST_F(test_comptheos, comptheo_wrappers) {
     double volMult = 1.0;
     std::chrono::minutes length{30};
@@ -368,7 +521,7 @@ TEST_F(test_comptheos, test_vwap_comptheo) {
 
     ASSERT_TRUE(vwapct->ticked()); 
     ASSERT_TRUE(vwapct->valid());  // everything has traded once
-    ASSERT_EQ(vwapct->value(), 110 * std::pow(93.0/94.0, vol_mult)); //==base_theo  
+    ASSERT_DOUBLE_EQ(vwapct->value(), 110 * std::pow(93.0/94.0, vol_mult)); //==base_theo  
 
     ref_msg.addTrade(MockBookTradeMsg{20, 92});
     ref_md->fireBookChange(ref_msg);
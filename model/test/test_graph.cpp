@@ -4,6 +4,7 @@
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
+#include "model/expr_nodes.h"
 #include "model/graph.h"
 #include "model/market_data.h"
 #include "model/theos.h"
@@ -16,6 +17,7 @@ namespace br = boost::range;
 using testing::Assign;
 using testing::Invoke;
 using testing::_;
+using testing::Throw;
 using testing::UnorderedElementsAre;
 using ::testing::NiceMock;
 
@@ -148,6 +150,24 @@ TEST_F(test_graph, factory_dtor) {
 }
 
 
+TEST_F(test_graph, arena_placement) {
+    TestGraph tg("NASDAQ:TSLA", 1);
+    auto before = tg.g->arena().bytesAllocated();
+    auto md = tg.g->add<RawMarketData>("NASDAQ:TSLA");
+    auto midpt = tg.g->add<Midpt>(md);
+    ASSERT_GT(tg.g->arena().bytesAllocated(), before);
+
+    // memoized adds don't allocate again
+    auto allocated = tg.g->arena().bytesAllocated();
+    ASSERT_EQ(tg.g->add<Midpt>(md), midpt);
+    ASSERT_EQ(tg.g->arena().bytesAllocated(), allocated);
+
+    // nodes allocated outside of Graph::add still use the heap
+    auto heapNode = new NiceMock<MockValueNode>(tg.g);
+    ASSERT_EQ(tg.g->arena().bytesAllocated(), allocated);
+    delete heapNode;
+}
+
 TEST_F(test_graph, multiple_graphs) {
     Graph* g1 = strategy.newGraph();
     Graph* g2 = strategy.newGraph();
@@ -180,6 +200,384 @@ TEST_F(test_graph, tree_updated) {
     EXPECT_THAT(last_two, UnorderedElementsAre(&sig2, &sig3));
 }
 
+TEST_F(test_graph, firing_plan_tree_updated) {
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    MockValueNode sig1(g), sig2(g);
+
+    sig1.setClock(&src);
+    ON_CALL(sig1, compute())
+        .WillByDefault(Invoke(&sig1, &MockValueNode::setValid));
+
+    src.fire();
+    ASSERT_TRUE((src.plan_.compiled()));
+    EXPECT_EQ(src.plan_.size(), 2u);
+
+    // Changing the tree invalidates the plan; the next fire recompiles it.
+    sig2.setClock(&sig1);
+    ASSERT_FALSE((src.plan_.compiled()));
+
+    EXPECT_CALL(sig2, compute())
+        .Times(1);
+    src.fire();
+    ASSERT_TRUE((src.plan_.compiled()));
+    EXPECT_EQ(src.plan_.size(), 3u);
+    ASSERT_TRUE((sig2.ticked()));
+}
+
+struct QuietClock : ClockNode {
+    QuietClock(Graph* g) : ClockNode(g) {}
+    void compute() override {
+        ticked_ = false;
+        status_ = StatusCode::OK;
+    }
+};
+
+TEST_F(test_graph, event_driven_skips_quiet_subtree) {
+    g->setEventDriven(true);
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    QuietClock quiet(g);
+    MockValueNode sig1(g), sig2(g), sig3(g);
+
+    quiet.setClock(&src);
+    sig1.setClock(&src);
+    sig2.setClock(&quiet);
+    sig3.setParent(&sig2);
+    sig3.setClock(&quiet);
+
+    EXPECT_CALL(sig1, compute())
+        .Times(1);
+    EXPECT_CALL(sig2, compute())
+        .Times(0);
+    EXPECT_CALL(sig3, compute())
+        .Times(0);
+
+    src.fire();
+
+    // only quiet and sig1 are visited; quiet's callbacks never enter the frontier.
+    EXPECT_EQ(src.plan_.size(), 5u);
+    EXPECT_EQ(src.plan_.fired().size(), 2u);
+    ASSERT_TRUE((sig1.ticked()));
+    ASSERT_FALSE((sig2.ticked()));
+    ASSERT_FALSE((sig3.ticked()));
+}
+
+TEST_F(test_graph, build_transaction_defers_order) {
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    MockValueNode sig1(g), sig2(g), sig3(g);
+    {
+        Graph::BuildTransaction transaction(g);
+        sig1.setClock(&src);
+        sig2.setClock(&sig1);
+        sig3.setParent(&sig2);
+        sig3.setClock(&src);
+        {
+            Graph::BuildTransaction nested(g);
+        }
+        // nothing is sorted until the outermost transaction closes
+        EXPECT_EQ(src.computeOrder_.size(), 0u);
+    }
+    ASSERT_EQ(src.computeOrder_.size(), 3u);
+    EXPECT_EQ(src.computeOrder_[0], &sig1);
+    EXPECT_EQ(src.computeOrder_[1], &sig2);
+    EXPECT_EQ(src.computeOrder_[2], &sig3);
+}
+
+TEST_F(test_graph, build_transaction_invalidates_plans) {
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    NiceMock<MockValueNode> sig1(g), sig2(g), sig3(g);
+    sig1.setClock(&src);
+    g->compileFiringPlans();
+    ASSERT_TRUE(src.plan_.compiled());
+    {
+        Graph::BuildTransaction transaction(g);
+        sig2.setClock(&sig1);
+        // the plan was compiled from the old order
+        EXPECT_FALSE(src.plan_.compiled());
+    }
+    EXPECT_EQ(src.computeOrder_.size(), 2u);
+
+    // a transaction unwound by an exception doesn't commit
+    try {
+        Graph::BuildTransaction transaction(g);
+        sig3.setClock(&src);
+        throw std::runtime_error("build failed");
+    } catch(std::runtime_error const&) {}
+    EXPECT_EQ(src.computeOrder_.size(), 2u);
+}
+
+TEST_F(test_graph, fire_burst_components) {
+    MockSourceNode src1(g, "NASDAQ:TSLA"), src2(g, "NASDAQ:AAPL"), src3(g, "NASDAQ:MSFT");
+    NiceMock<MockValueNode> sig1(g), sig2(g), sig3(g), shared(g);
+    sig1.setClock(&src1);
+    sig2.setClock(&src2);
+    sig3.setClock(&src3);
+    // shared is fired by src1 and src3, so they must not run concurrently
+    shared.setParent(&sig3);
+    shared.setClock(&src1, &src3);
+    for(auto sig : {&sig1, &sig2, &sig3, &shared})
+        ON_CALL(*sig, compute())
+            .WillByDefault(Invoke(sig, &MockValueNode::setValid));
+
+    g->compileFiringPlans();
+    EXPECT_EQ(g->numSourceComponents(), 2u);
+    EXPECT_EQ(src1.component_, src3.component_);
+    EXPECT_NE(src1.component_, src2.component_);
+
+    g->setWorkerThreads(2);
+    EXPECT_CALL(sig1, compute()).Times(1);
+    EXPECT_CALL(sig2, compute()).Times(1);
+    EXPECT_CALL(sig3, compute()).Times(1);
+    EXPECT_CALL(shared, compute()).Times(2);
+    int eventId = g->eventId();
+    g->fireBurst({&src1, &src2, &src3});
+    EXPECT_EQ(g->eventId(), eventId + 3);
+    EXPECT_TRUE(shared.valid());
+    EXPECT_EQ(g->currentSource(), nullptr);
+    g->setWorkerThreads(0);
+}
+
+TEST_F(test_graph, fire_burst_exception) {
+    MockSourceNode src1(g, "NASDAQ:TSLA"), src2(g, "NASDAQ:AAPL");
+    NiceMock<MockValueNode> sig1(g), sig2(g);
+    sig1.setClock(&src1);
+    sig2.setClock(&src2);
+    ON_CALL(sig1, compute())
+        .WillByDefault(Invoke(&sig1, &MockValueNode::setValid));
+    ON_CALL(sig2, compute())
+        .WillByDefault(Throw(std::runtime_error("sig2")));
+
+    g->setWorkerThreads(2);
+    //the other component still fires, and the worker's exception reaches the caller
+    EXPECT_CALL(sig1, compute()).Times(1);
+    EXPECT_THROW(g->fireBurst({&src1, &src2}), std::runtime_error);
+    EXPECT_TRUE(sig1.valid());
+    EXPECT_EQ(g->currentSource(), nullptr);
+    g->setWorkerThreads(0);
+}
+
+TEST_F(test_graph, level_parallel_firing) {
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    NiceMock<MockValueNode> sig1(g), sig2(g), sig3(g), val(g);
+    sig1.setClock(&src);
+    sig2.setClock(&src);
+    sig3.setClock(&src);
+    val.setParent(&sig3);
+    val.setClock(&sig1, &sig2);
+    for(auto sig : {&sig1, &sig2, &sig3, &val})
+        ON_CALL(*sig, compute())
+            .WillByDefault(Invoke(sig, &MockValueNode::setValid));
+
+    g->compileFiringPlans();
+    ASSERT_EQ(src.plan_.numLevels(), 3u);
+    EXPECT_EQ(src.plan_.levelWidth(1), 3u);
+    EXPECT_EQ(src.plan_.levelWidth(2), 1u);
+
+    // a zero threshold sends every wide level to the pool
+    g->setLevelParallel(2, 0);
+    EXPECT_CALL(sig1, compute()).Times(1);
+    EXPECT_CALL(sig2, compute()).Times(1);
+    EXPECT_CALL(sig3, compute()).Times(1);
+    EXPECT_CALL(val, compute()).Times(1);
+    src.fire();
+    EXPECT_TRUE(val.valid());
+    EXPECT_GT(src.plan_.cost(1), 0);
+
+    // a worker's exception reaches the caller, naming the node that threw
+    EXPECT_CALL(sig1, compute()).Times(1);
+    EXPECT_CALL(sig2, compute()).WillOnce(Throw(std::runtime_error("sig2")));
+    EXPECT_CALL(sig3, compute()).Times(1);
+    EXPECT_THROW(src.fire(), std::runtime_error);
+    EXPECT_EQ(src.currentNode(), &sig2);
+    g->setLevelParallel(0);
+}
+
+TEST_F(test_graph, node_profiler) {
+    for(uint64_t c : {0ul, 7ul, 16ul, 17ul, 1000ul, 123456789ul}) {
+        auto b = NodeProfiler::bucketOf(c);
+        ASSERT_LT(b, NodeProfiler::numBuckets);
+        EXPECT_LE(NodeProfiler::bucketFloor(b), c);
+        EXPECT_GT(NodeProfiler::bucketFloor(b + 1), c);
+    }
+
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    NiceMock<MockValueNode> sig1(g), sig2(g);
+    sig1.setClock(&src);
+    sig2.setClock(&src);
+    sig1.setName("sig1");
+
+    g->setProfiling(true);
+    src.fire();
+    src.fire();
+    EXPECT_EQ(g->profiler()->stats(sig1.index()).calls, 2u);
+    EXPECT_EQ(g->profiler()->stats(sig2.index()).calls, 2u);
+    EXPECT_EQ(g->profiler()->stats(src.index()).calls, 0u);
+
+    std::ostringstream report;
+    g->profileReport(report);
+    EXPECT_NE(report.str().find("sig1"), std::string::npos);
+
+    g->setProfiling(false);
+    EXPECT_EQ(g->profiler(), nullptr);
+}
+
+struct AllocatingNode : ValueNode {
+    AllocatingNode(Graph* g, ClockNode* clock) : ValueNode(g) { setClock(clock); }
+    void compute() override {
+        if(allocate)
+            buffer.reset(new double[64]);
+        value_ = 1;
+        status_ = StatusCode::OK;
+    }
+    std::string defaultName() const override { return "AllocatingNode"; }
+    bool allocate{false};
+    std::unique_ptr<double[]> buffer;
+};
+
+TEST_F(test_graph, allocation_check) {
+    if(not AllocationTracker::enabled())
+        GTEST_SKIP() << "alloc_hook.cpp isn't linked in";
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    AllocatingNode node(g, &src);
+
+    g->setAllocationCheck(true, g->eventId() + 2);
+    node.allocate = true;
+    src.fire(); // still warming up
+    src.fire();
+    node.allocate = false;
+    EXPECT_NO_THROW(src.fire());
+
+    node.allocate = true;
+    try {
+        src.fire();
+        FAIL() << "allocation inside SourceNode::fire not detected";
+    } catch(std::logic_error const& e) {
+        EXPECT_NE(std::string(e.what()).find("AllocatingNode"), std::string::npos);
+    }
+    g->setAllocationCheck(false);
+}
+
+struct PlusOne : ValueNode {
+    PlusOne(Graph* g, ValueNode* parent) : ValueNode(g), parent_(parent) { setClock(parent); }
+    void compute() override {
+        ++nComputes;
+        value_ = parent_->value() + 1;
+        status_ = StatusCode::OK;
+    }
+    bool stateless() const override { return true; }
+    std::string defaultName() const override { return "PlusOne"; }
+    ValueNode* parent_;
+    int nComputes{0};
+};
+
+TEST_F(test_graph, lazy_evaluation) {
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    AllocatingNode parent(g, &src);
+    PlusOne lazy(g, &parent);
+    EXPECT_THROW(parent.setLazy(), std::logic_error);
+    lazy.setLazy();
+
+    for(int i=0; i<3; ++i)
+        src.fire();
+    EXPECT_TRUE(lazy.stale());
+    EXPECT_EQ(lazy.nComputes, 0);
+    EXPECT_EQ(lazy.heldValue(), 2);
+    EXPECT_EQ(lazy.nComputes, 1);
+    EXPECT_EQ(lazy.heldValue(), 2);
+    EXPECT_EQ(lazy.nComputes, 1);
+
+    src.fire();
+    EXPECT_EQ(lazy.value(), 2);
+    EXPECT_EQ(lazy.nComputes, 2);
+
+    //a child evaluates its stale lazy parent before checking it's valid
+    PlusOne child(g, &lazy);
+    src.fire();
+    EXPECT_FALSE(lazy.stale());
+    EXPECT_EQ(lazy.nComputes, 3);
+    EXPECT_EQ(child.value(), 3);
+}
+
+struct Counter : ValueNode {
+    Counter(Graph* g, ClockNode* clock, double step) : ValueNode(g), step_(step) { value_ = 0; setClock(clock); }
+    void compute() override {
+        value_ += step_;
+        status_ = StatusCode::OK;
+    }
+    std::string defaultName() const override { return "Counter"; }
+    double step_;
+};
+
+//scale * (x - y) and (x + c) / -y, each in one node
+struct LocalScaledDiff : Expr<Mul<Param<0>, Sub<Arg<0>, Arg<1>>>> {
+    LocalScaledDiff(Graph* g, double scale, ValueNode* x, ValueNode* y) : Expr(g, {{scale}}, {{x, y}}) {}
+    std::string defaultName() const override { return "LocalScaledDiff"; }
+};
+struct NegRatio : Expr<Div<Add<Arg<0>, Param<0>>, Neg<Arg<1>>>> {
+    NegRatio(Graph* g, double c, ValueNode* x, ValueNode* y) : Expr(g, {{c}}, {{x, y}}) {}
+    std::string defaultName() const override { return "NegRatio"; }
+};
+
+TEST_F(test_graph, expr_nodes) {
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    Counter x(g, &src, 3), y(g, &src, 1);
+    LocalScaledDiff diff(g, 2, &x, &y);
+    NegRatio ratio(g, 1, &y, &x);
+    static_assert(LocalScaledDiff::numInputs == 2 and LocalScaledDiff::numParams == 1, "");
+    EXPECT_TRUE(diff.hasParent(&x));
+    EXPECT_TRUE(diff.hasParent(&y));
+    EXPECT_TRUE(diff.stateless());
+
+    src.fire();
+    src.fire();
+    EXPECT_EQ(diff.value(), 2 * (6 - 2));
+    EXPECT_EQ(ratio.value(), (2 + 1) / -6.0);
+}
+
+TEST_F(test_graph, expr_nodes_serialize) {
+    auto md = g->add<MockEventSourceMarketData>("NASDAQ:AAPL");
+    auto wave = g->add<WeightAve>(md);
+    auto mid = g->add<Midpt>(md);
+    auto diff = g->add<ScaledDiff>(2.0, wave, mid);
+    EXPECT_EQ(g->add<ScaledDiff>(2.0, wave, mid), diff);
+
+    //deserializing the formula finds the same node again
+    Parameters params = diff->serialize();
+    EXPECT_EQ(g->deserialize<ValueNode>(params), diff);
+    EXPECT_EQ(g->deserialize<ScaledDiff>(params)->scale_, 2);
+
+    NiceMock<MockBookFiniteDepthMsg> msg;
+    md::Book book;
+    msg.setOutrightBook(&book);
+    book.insert(md::Order{1001, Side::Bid, 300, 10.0});
+    book.insert(md::Order{1002, Side::Ask, 100, 11.0});
+    md->fireBookChange(msg);
+    EXPECT_DOUBLE_EQ(diff->value(), 2 * (10.75 - 10.5));
+}
+
+TEST_F(test_graph, latency_recorder) {
+    LatencyRecorder recorder;
+    auto a = recorder.registerSlot("a");
+    EXPECT_EQ(recorder.registerSlot("b"), a + 1);
+    EXPECT_EQ(recorder.registerSlot("a"), a);
+    for(int i=1; i<=100; ++i)
+        recorder.record(a, std::chrono::nanoseconds(i * 1000));
+    auto before = recorder.snapshot(a);
+    EXPECT_EQ(before.count, 100u);
+    EXPECT_EQ(before.maxNanos, 100000u);
+    EXPECT_NEAR(before.percentile(0.5), 50000, 50000 * 0.13);
+    recorder.record(a, std::chrono::nanoseconds(7));
+    auto after = recorder.snapshot(a);
+    after -= before;
+    EXPECT_EQ(after.count, 1u);
+    EXPECT_EQ(after.percentile(0.99), 7u);
+
+    MockSourceNode src(g, "NASDAQ:TSLA");
+    src.fire();
+    src.fire();
+    auto& latency = const_cast<LatencyRecorder&>(g->latency());
+    EXPECT_EQ(latency.snapshot(latency.registerSlot(src.getName())).count, 2u);
+}
+
 // Make sure signals are only fired once when two clocks are set.
 TEST_F(test_graph, test_no_duplicate_fire) {
     MockSourceNode src(g, "NASDAQ:TSLA");
@@ -317,6 +715,24 @@ TEST_F(test_graph, test_topological_sort) {
     ASSERT_TRUE(br::find(order,&val)>br::find(order,&ct0));
 }
 
+TEST_F(test_graph, deep_chain_traversal) {
+    // deep enough to overflow the stack with a recursive DFS
+    constexpr size_t depth = 200000;
+    std::vector<std::unique_ptr<MockInitNode>> chain;
+    chain.emplace_back(new MockInitNode(g));
+    for(size_t i=1; i<depth; ++i) {
+        chain.emplace_back(new MockInitNode(g));
+        chain[i]->setParent(chain[i-1].get());
+    }
+
+    std::vector<Node*> order;
+    topological_sort(chain.front().get(), order);
+    ASSERT_EQ(order.size(), depth);
+    for(size_t i=0; i<depth; ++i)
+        ASSERT_EQ(order[i], chain[i].get());
+    EXPECT_FALSE(g->isCyclic());
+}
+
 
 TEST_F(test_graph, theo_factory) {
     std::vector<std::string> v { "WeightAve", "Midpt", "CompTheo", "EMA" };
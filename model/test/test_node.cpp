@@ -40,6 +40,18 @@ TEST_F(test_node, test_setClock) {
     ASSERT_TRUE(val2.getClock() == val3.getClock());
 }
 
+TEST_F(test_node, test_dense_index_ordering) {
+    MockInitNode a(g), b(g), c(g);
+    EXPECT_EQ(b.index(), a.index() + 1);
+    EXPECT_EQ(c.index(), b.index() + 1);
+    EXPECT_EQ(g->nodes[a.index()], &a);
+
+    // NodeSets iterate in creation order, independent of addresses
+    NodeSet nodeSet{&c, &a, &b};
+    std::vector<Node*> ordered(nodeSet.begin(), nodeSet.end());
+    EXPECT_EQ(ordered, (std::vector<Node*>{&a, &b, &c}));
+}
+
 TEST_F(test_node, test_combineNodes) {
     MockInitNode sig1(g), sig2(g), sig3(g);
     MockValueNode val(g);
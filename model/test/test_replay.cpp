@@ -0,0 +1,151 @@
+#include <chrono>
+#include <cstdlib>
+#include <map>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include "model/replay.h"
+#include "model/theos.h"
+#include "model/test/clock_override.h"
+#include "model/test/mock_bookmsg.h"
+#include "model/test/mock_event_source_market_data.h"
+#include "model/test/utils.h"
+
+using testing::NiceMock;
+
+struct test_replay : public ::testing::Test, TestGraphMultiSym {
+    test_replay() : TestGraphMultiSym({"BTEC:US10Y", "ESPEED:US10Y"}, {1., 1.})
+                  , fileName(makeTempFile())
+    {}
+    void TearDown() override { ::unlink(fileName.c_str()); }
+
+    //mkstemp creates the file, so no other process can take the name first.
+    static std::string makeTempFile() {
+        std::string path = ::testing::TempDir() + "test_replay_XXXXXX";
+        int fd = ::mkstemp(&path[0]);
+        if(fd < 0)
+            throw std::runtime_error("test_replay: mkstemp failed for " + path);
+        ::close(fd);
+        return path;
+    }
+
+    ReplayRecord record(uint16_t symbol, ReplayRecord::Type type, int64_t t,
+                        uint64_t id, Side side, int32_t size, double price, bool last) {
+        ReplayRecord r{};
+        r.exchangeNs = t;
+        r.receiveNs = t;
+        r.orderId = id;
+        r.price = price;
+        r.size = size;
+        r.symbol = symbol;
+        r.type = type;
+        r.flags = (side == Side::Ask ? ReplayRecord::ASK : 0)
+                | (last ? ReplayRecord::END_OF_PACKET : 0);
+        return r;
+    }
+
+    //Fires MockEventSourceMarketData through the engine's books.
+    struct Handler {
+        void advanceClock(std::chrono::nanoseconds dt) {
+            clock.incrementTime(std::chrono::duration_cast<millis>(dt));
+            elapsed += dt;
+        }
+        void onPacket(uint16_t symbol, ReplaySymbol& state) {
+            auto& msg = msgs[symbol];
+            msg.setOutrightBook(&state.book);
+            msg.clearTrades();
+            for(auto const& trade : state.trades)
+                msg.addTrade(MockBookTradeMsg{trade.size, trade.price});
+            sources[symbol]->fireBookChange(msg);
+            ++packets[symbol];
+        }
+        void onPrivate(ReplayRecord const&) { ++privates; }
+
+        std::vector<MockEventSourceMarketData*> sources;
+        std::map<uint16_t, NiceMock<MockBookFiniteDepthMsg>> msgs;
+        std::map<uint16_t, int> packets;
+        clock_override clock;
+        std::chrono::nanoseconds elapsed{0};
+        int privates{0};
+    };
+
+    std::string fileName;
+};
+
+TEST_F(test_replay, round_trip) {
+    using Type = ReplayRecord::Type;
+    {
+        ReplayWriter writer(fileName);
+        auto btec = writer.addSymbol("BTEC:US10Y");
+        auto espeed = writer.addSymbol("ESPEED:US10Y");
+        EXPECT_EQ(writer.addSymbol("BTEC:US10Y"), btec);
+        int64_t ms = 1000000;
+        writer.write(record(btec, Type::ADD, 1*ms, 1001, Side::Bid, 100, 10.0, false));
+        writer.write(record(btec, Type::ADD, 1*ms, 1002, Side::Ask, 100, 11.0, true));
+        writer.write(record(espeed, Type::ADD, 2*ms, 2001, Side::Bid, 100, 10.0, false));
+        writer.write(record(espeed, Type::ADD, 2*ms, 2002, Side::Ask, 100, 12.0, true));
+        writer.write(record(0, Type::PRIVATE, 3*ms, 7, Side::Bid, 0, 0, false));
+        writer.write(record(btec, Type::CANCEL, 5*ms, 1002, Side::Ask, 0, 0, false));
+        writer.write(record(btec, Type::ADD, 5*ms, 1003, Side::Ask, 100, 10.5, false));
+        writer.write(record(btec, Type::TRADE, 5*ms, 0, Side::Ask, 5, 10.5, true));
+    }
+
+    ReplayReader reader(fileName);
+    ASSERT_EQ(reader.symbols().size(), 2u);
+    EXPECT_EQ(reader.symbols()[1], "ESPEED:US10Y");
+    ASSERT_EQ(reader.size(), 8u);
+    EXPECT_EQ(reader.begin()[3].orderId, 2002u);
+    EXPECT_TRUE(reader.begin()[3].endOfPacket());
+
+    Handler handler;
+    for(auto const& symbol : reader.symbols())
+        handler.sources.push_back(g->add<MockEventSourceMarketData>(symbol));
+    auto btecMid = g->add<Midpt>(handler.sources[0]);
+    auto espeedMid = g->add<Midpt>(handler.sources[1]);
+
+    ReplayEngine engine(reader);
+    auto stats = engine.run(handler);
+    EXPECT_EQ(stats.records, 8u);
+    EXPECT_EQ(stats.packets, 3u);
+    EXPECT_EQ(handler.packets[0], 2);
+    EXPECT_EQ(handler.packets[1], 1);
+    EXPECT_EQ(handler.privates, 1);
+    EXPECT_EQ(handler.elapsed, std::chrono::milliseconds(4));
+    EXPECT_NEAR(btecMid->heldValue(), 10.25, 1e-9);
+    EXPECT_NEAR(espeedMid->heldValue(), 11.0, 1e-9);
+}
+
+TEST_F(test_replay, clock_from_zero) {
+    using Type = ReplayRecord::Type;
+    int64_t ms = 1000000;
+    {
+        ReplayWriter writer(fileName);
+        auto btec = writer.addSymbol("BTEC:US10Y");
+        writer.write(record(btec, Type::ADD, 0, 1001, Side::Bid, 100, 10.0, false));
+        writer.write(record(btec, Type::ADD, 0, 1002, Side::Ask, 100, 11.0, true));
+        writer.write(record(btec, Type::ADD, 2*ms, 1003, Side::Bid, 100, 10.5, true));
+        writer.write(record(btec, Type::CANCEL, 1*ms, 1003, Side::Bid, 0, 0, true));
+    }
+
+    ReplayReader reader(fileName);
+    Handler handler;
+    handler.sources.push_back(g->add<MockEventSourceMarketData>("BTEC:US10Y"));
+
+    //a first record at time zero still starts the clock, and one that goes
+    //back in time is an error rather than replayed out of order
+    ReplayEngine engine(reader);
+    EXPECT_THROW(engine.run(handler), std::runtime_error);
+    EXPECT_EQ(handler.elapsed, std::chrono::milliseconds(2));
+    EXPECT_EQ(handler.packets[0], 2);
+}
+
+TEST_F(test_replay, bad_file) {
+    {
+        std::ofstream f(fileName, std::ios::binary);
+        f << "not a replay file";
+    }
+    EXPECT_THROW(ReplayReader{fileName}, std::runtime_error);
+}
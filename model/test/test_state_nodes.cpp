@@ -5,8 +5,12 @@
 #include "model/test/mock_event_source_market_data.h"
 #include "model/test/clock_override.h"
 
+#include "model/decay.h"
+#include "model/decayed_cov_matrix.h"
+#include "model/decayed_sum_bank.h"
 #include "model/util_nodes.h"
 #include "model/state_nodes.h"
+#include "model/theos.h"
 #include <vhl/IvBookFiniteDepthMsg.hpp>
 
 #include <vpl/Price.hpp>
@@ -257,4 +261,204 @@ TEST_F(test_state_nodes, test_trade_momentum) {
     ASSERT_TRUE((trade_momentum_size->ticked()));
 }
 
+TEST_F(test_state_nodes, decay_kernel) {
+    Decay linear(std::chrono::nanoseconds(1000));
+    EXPECT_DOUBLE_EQ(linear.factor(250), 0.75);
+    EXPECT_DOUBLE_EQ(linear.factor(5000), 0);
+
+    Decay exact(std::chrono::nanoseconds(1000), Decay::Kind::EXP);
+    for(double dt : {0.0, 1.0, 250.0, 1000.0, 12345.0, 400000.0})
+        EXPECT_NEAR(exact.factor(dt) / std::exp(-dt / 1000), 1, 1e-6);
+    EXPECT_EQ(exact.factor(1e12), 0);
+
+    for(double x : {-700.0, -20.0, -1.0, -1e-3, 0.0, 1e-3, 0.5, 1.0, 30.0, 700.0})
+        EXPECT_NEAR(Decay::expSigned(x) / std::exp(x), 1, 1e-13);
+    EXPECT_EQ(Decay::expSigned(0), 1);
+    EXPECT_GT(Decay::expSigned(-1e6), 0);
+
+    double a = 2, b = 4;
+    double c[3] = {1, 2, 3};
+    EXPECT_DOUBLE_EQ(linear.apply(500, a, b), 0.5);
+    EXPECT_DOUBLE_EQ(a, 1);
+    EXPECT_DOUBLE_EQ(b, 2);
+    linear.apply(500, c, 3);
+    EXPECT_DOUBLE_EQ(c[2], 1.5);
+}
+
+TEST_F(test_state_nodes, decayed_sum_bank) {
+    using millis = std::chrono::milliseconds;
+    auto on_trade = g->add<OnTrade>(md);
+    auto padded_size = g->add<Pad>(g->add<TradeSize>(md), on_trade, 0);
+    auto bank = g->add<DecayedSumBank>(padded_size, on_trade);
+    auto short_sum = g->add<DecayedSum>(bank, millis{100});
+    auto long_sum = g->add<DecayedSum>(bank, millis{400});
+    EXPECT_EQ(g->add<DecayedSumBank>(padded_size, on_trade), bank);
+    EXPECT_EQ(g->add<DecayedSum>(bank, millis{100}), short_sum);
+    EXPECT_EQ(bank->numHorizons(), 2u);
+
+    b.insert(md::Order{1001, Side::Bid, 200, 10.0});
+    b.insert(md::Order{1002, Side::Ask, 300, 11.0});
+    md->fireBookChange(msg);
+
+    msg.addTrade(MockBookTradeMsg{10, 10});
+    md->fireBookChange(msg);
+    msg.clearTrades();
+    //views only copy their sum out when read
+    EXPECT_TRUE(short_sum->stale());
+    EXPECT_NEAR(short_sum->value(), 10, 1e-9);
+    EXPECT_FALSE(short_sum->stale());
+    EXPECT_NEAR(long_sum->value(), 10, 1e-9);
+
+    Int64 start = g->nSecUptime();
+    clock.incrementTime(millis{50});
+    msg.addTrade(MockBookTradeMsg{4, 10});
+    md->fireBookChange(msg);
+    msg.clearTrades();
+    double elapsed = g->nSecUptime() - start;
+    EXPECT_NEAR(short_sum->value(), 10 * (1 - elapsed / 100e6) + 4, 1e-6);
+    EXPECT_NEAR(long_sum->value(), 10 * (1 - elapsed / 400e6) + 4, 1e-6);
+}
+
+TEST_F(test_state_nodes, decayed_sum_matches_time_decayed_sum) {
+    using millis = std::chrono::milliseconds;
+    auto on_trade = g->add<OnTrade>(md);
+    auto padded_size = g->add<Pad>(g->add<TradeSize>(md), on_trade, 0);
+    //what AccumRefreshed, TradeAggression and the rest used to build
+    auto old_sum = g->add<TimeDecayedSum>(padded_size, on_trade, millis{100});
+    auto new_sum = g->add<DecayedSum>(g->add<DecayedSumBank>(padded_size, on_trade), millis{100});
+
+    auto exp_bank = g->add<DecayedSumBank>(padded_size, on_trade, Decay::Kind::EXP);
+    EXPECT_NE(exp_bank, new_sum->bank_);
+    EXPECT_EQ(g->add<DecayedSumBank>(padded_size, on_trade, Decay::Kind::EXP), exp_bank);
+    EXPECT_EQ(exp_bank->decay_kind_, Decay::Kind::EXP);
+    EXPECT_EQ(new_sum->bank_->decay_kind_, Decay::Kind::LINEAR);
+
+    b.insert(md::Order{1001, Side::Bid, 200, 10.0});
+    b.insert(md::Order{1002, Side::Ask, 300, 11.0});
+    md->fireBookChange(msg);
+
+    //gaps short of, and past, the horizon
+    for ( int gap : {0, 10, 40, 99, 150, 5} ) {
+        clock.incrementTime(millis{gap});
+        msg.addTrade(MockBookTradeMsg{gap % 7 + 1, 10});
+        md->fireBookChange(msg);
+        msg.clearTrades();
+        EXPECT_NEAR(new_sum->value(), old_sum->value(), 1e-9);
+    }
+}
+
+TEST_F(test_state_nodes, hy_cov_tick_decay) {
+    //both signals tick on the same book changes, which HYTimeCov can't take
+    auto mid = g->add<Midpt>(md);
+    auto wave = g->add<WeightAve>(md);
+    auto cov = g->add<HYCov>(mid, wave, std::chrono::nanoseconds(0), 2, md);
+
+    b.insert(md::Order{1001, Side::Bid, 100, 10.0});
+    b.insert(md::Order{1002, Side::Ask, 100, 11.0});
+    md->fireBookChange(msg);
+    EXPECT_EQ(cov->value(), 0);
 
+    //mid 10.5 -> 10.75, wave 10.5 -> 10.875; halved, then the product added
+    b.insert(md::Order{1003, Side::Bid, 300, 10.5});
+    md->fireBookChange(msg);
+    EXPECT_DOUBLE_EQ(cov->value(), 0.25 * 0.375);
+
+    //mid 10.75 -> 10.625, wave 10.875 -> 10.6875
+    b.insert(md::Order{1004, Side::Ask, 100, 10.75});
+    md->fireBookChange(msg);
+    EXPECT_DOUBLE_EQ(cov->value(), 0.5 * 0.25 * 0.375 + 0.125 * 0.1875);
+}
+
+TEST_F(test_state_nodes, decay_kind_param) {
+    using millis = std::chrono::milliseconds;
+    auto mid = g->add<Midpt>(md);
+    auto linear = g->add<QuadraticVariation>(mid, millis{500}, md);
+    auto exact = g->add<QuadraticVariation>(mid, millis{500}, md, Decay::Kind::EXP);
+    EXPECT_NE(linear, exact);
+    EXPECT_EQ(g->add<QuadraticVariation>(mid, millis{500}, md, Decay::Kind::LINEAR), linear);
+    EXPECT_EQ(linear->decay_.kind(), Decay::Kind::LINEAR);
+    EXPECT_EQ(exact->decay_.kind(), Decay::Kind::EXP);
+    EXPECT_NE(linear->getName(), exact->getName());
+
+    b.insert(md::Order{1001, Side::Bid, 100, 10.0});
+    b.insert(md::Order{1002, Side::Ask, 100, 11.0});
+    md->fireBookChange(msg);
+    //mid 10.5 -> 10.75
+    b.insert(md::Order{1003, Side::Bid, 100, 10.5});
+    md->fireBookChange(msg);
+    EXPECT_DOUBLE_EQ(linear->value(), 0.0625);
+    EXPECT_DOUBLE_EQ(exact->value(), 0.0625);
+
+    //mid 10.75 -> 10.625
+    Int64 start = g->nSecUptime();
+    clock.incrementTime(millis{100});
+    b.insert(md::Order{1004, Side::Ask, 100, 10.75});
+    md->fireBookChange(msg);
+    double elapsed = g->nSecUptime() - start;
+    EXPECT_NEAR(linear->value(), 0.0625 * (1 - elapsed / 500e6) + 0.015625, 1e-9);
+    EXPECT_NEAR(exact->value(), 0.0625 * std::exp(-elapsed / 500e6) + 0.015625, 1e-7);
+}
+
+struct test_cov_matrix : public ::testing::Test, TestGraphMultiSym
+{
+    test_cov_matrix() : TestGraphMultiSym({"BTEC:US2Y", "BTEC:US5Y", "BTEC:US10Y"}, {1., 1., 1.})
+    {
+        for ( auto sym : {"BTEC:US2Y", "BTEC:US5Y", "BTEC:US10Y"} )
+            mds.push_back(g->add<MockEventSourceMarketData>(sym));
+        for ( size_t i=0; i<3; ++i )
+            msgs[i].setOutrightBook(&books[i]);
+    }
+
+    //moves instrument i's bid, so its midpt moves by half of that
+    void moveBid(size_t i, double bid) {
+        books[i].insert(md::Order{next_order_id++, Side::Bid, 100, bid});
+        clock.incrementTime(std::chrono::milliseconds{10});
+        mds[i]->fireBookChange(msgs[i]);
+    }
+
+    std::vector<MockEventSourceMarketData*> mds;
+    NiceMock<MockBookFiniteDepthMsg> msgs[3];
+    md::Book books[3];
+    uint64_t next_order_id{1};
+    clock_override clock;
+};
+
+TEST_F(test_cov_matrix, decayed_cov_matrix) {
+    using millis = std::chrono::milliseconds;
+    std::vector<ValueNode*> mids;
+    for ( auto md : mds )
+        mids.push_back(g->add<Midpt>(md));
+    auto matrix = g->add<DecayedCovMatrix>(mids, millis{500}, mds[0]);
+    EXPECT_EQ(matrix->decay_kind_, Decay::Kind::EXP);
+    EXPECT_NE(g->add<DecayedCovMatrix>(mids, millis{500}, mds[0], Decay::Kind::LINEAR), matrix);
+    auto cov_01 = g->add<DecayedCov>(matrix, mids[0], mids[1]);
+    auto corr_01 = g->add<DecayedCorr>(matrix, mids[0], mids[1]);
+    auto var_0 = g->add<DecayedCov>(matrix, mids[0], mids[0]);
+    EXPECT_THROW(g->add<DecayedCov>(matrix, mids[0], g->add<WeightAve>(mds[0])), std::invalid_argument);
+
+    //the same pair, kept pairwise, with the same decay
+    auto hy_01 = g->add<HYTimeCov>(mids[0], mids[1], millis{500}, mds[0], Decay::Kind::EXP);
+
+    for ( size_t i=0; i<3; ++i ) {
+        books[i].insert(md::Order{next_order_id++, Side::Bid, 100, 99.0});
+        books[i].insert(md::Order{next_order_id++, Side::Ask, 100, 101.0});
+        mds[i]->fireBookChange(msgs[i]);
+    }
+
+    //0 and 1 move together, with 2 ticking in between
+    moveBid(0, 99.5);
+    moveBid(2, 99.5);
+    moveBid(1, 99.5);
+    moveBid(0, 99.75);
+    moveBid(1, 99.75);
+    moveBid(2, 99.25);
+    moveBid(0, 100.0);
+    moveBid(1, 100.0);
+
+    EXPECT_GT(cov_01->value(), 0);
+    EXPECT_NEAR(cov_01->value(), hy_01->heldValue(), 1e-6 * std::abs(hy_01->heldValue()));
+    EXPECT_DOUBLE_EQ(matrix->cov(1, 0), matrix->cov(0, 1));
+    EXPECT_GT(var_0->value(), 0);
+    EXPECT_GT(corr_01->value(), 0);
+    EXPECT_LE(corr_01->value(), 1 + 1e-12);
+}
@@ -1,7 +1,11 @@
+#include <algorithm>
+#include <limits>
+
 #include <gtest/gtest.h>
 #include <gmock/gmock.h>
 
 #include "mock_bookmsg.h"
+#include "model/book_levels.h"
 #include "model/util_nodes.h"
 #include "model/theos.h"
 #include <vhl/IvBookFiniteDepthMsg.hpp>
@@ -94,6 +98,77 @@ TEST_F(test_theos, test_bookDepth) {
     EXPECT_EQ(1u, md->depth());
  }
 
+namespace {
+struct BookLevelsAccess : BookLevels {
+    using BookLevels::Side;
+};
+struct TestPrice {
+    double p;
+    bool isZero() const { return p == 0; }
+    double toDouble() const { return p; }
+};
+}
+
+TEST_F(test_theos, book_levels_empty_top) {
+    //bid level 0 is empty; the zeroed cache mustn't count it as unchanged
+    BookLevelsAccess::Side bid;
+    TestPrice prices[3] = {{0}, {9.0}, {8.0}};
+    double sizes[3] = {0, 4, 6};
+    double counts[3] = {0, 1, 2};
+    EXPECT_TRUE(bid.update(prices, sizes, counts, 3, false));
+    EXPECT_EQ(bid.key[0], std::numeric_limits<double>::lowest());
+    EXPECT_EQ(bid.key[1], -9.0);
+    EXPECT_TRUE(std::is_sorted(bid.key.begin(), bid.key.end()));
+    EXPECT_EQ(bid.cum_size[3], 10);
+
+    EXPECT_FALSE(bid.update(prices, sizes, counts, 3, false));
+    prices[2].p = 7.0;
+    EXPECT_TRUE(bid.update(prices, sizes, counts, 3, false));
+    EXPECT_EQ(bid.key[2], -7.0);
+    EXPECT_TRUE(std::is_sorted(bid.key.begin(), bid.key.end()));
+    EXPECT_EQ(bid.cum_size_notional[3], 4 * 9.0 + 6 * 7.0);
+}
+
+TEST_F(test_theos, book_levels) {
+    auto levels = g->add<BookLevels>(md);
+    ASSERT_EQ(g->add<BookLevels>(md), levels);
+
+    b.insert(md::Order{1001, Side::Bid, 5, 10.0});
+    b.insert(md::Order{1002, Side::Bid, 4, 9.0});
+    b.insert(md::Order{1003, Side::Bid, 6, 9.0});
+    b.insert(md::Order{2001, Side::Ask, 3, 11.0});
+    b.insert(md::Order{2002, Side::Ask, 7, 13.0});
+    b.insert(md::Order{2003, Side::Ask, 1, 14.0});
+    md->fireBookChange(msg);
+
+    EXPECT_EQ(levels->sizeToLevel(false, 2), 15);
+    EXPECT_EQ(levels->countToLevel(false, 2), 3);
+    EXPECT_EQ(levels->sizeToLevel(true, 1), 3);
+    EXPECT_EQ(levels->sizeToLevel(true, 10), 11);
+
+    //same results as walking the book
+    for(bool is_ask : {false, true}) {
+        for(size_t max_depth : {1, 2, 4, 8}) {
+            double inside = is_ask ? 11.0 : 10.0;
+            double stop = inside + (is_ask ? 1 : -1) * 1.0 * (max_depth - 1);
+            for(double size : {0.0, 1.0, 3.0, 3.5, 8.0, 10.0, 11.0, 40.0}) {
+                auto const* sizes = is_ask ? md->askSizesPtr() : md->bidSizesPtr();
+                auto const* counts = is_ask ? md->askNumOrdersPtr() : md->bidNumOrdersPtr();
+                EXPECT_DOUBLE_EQ(levels->priceToFill(is_ask, false, size, stop),
+                                 priceToFillImpl(md, sizes, md, max_depth, is_ask, size));
+                EXPECT_DOUBLE_EQ(levels->priceToFill(is_ask, true, size, stop),
+                                 priceToFillImpl(md, counts, md, max_depth, is_ask, size));
+            }
+        }
+    }
+
+    //an ask-only change leaves the bid side cached
+    b.cancel(2001);
+    md->fireBookChange(msg);
+    EXPECT_EQ(levels->sizeToLevel(true, 1), 7);
+    EXPECT_EQ(levels->sizeToLevel(false, 2), 15);
+}
+
 TEST_F(test_theos, test_FillAve) {
     bool use_counts = true;
     size_t max_depth = 2;
@@ -111,6 +186,34 @@ TEST_F(test_theos, test_FillAve) {
     EXPECT_LT(sig->value(), 10.0);
 }
 
+TEST_F(test_theos, fill_curve) {
+    size_t fill_depth = 3;
+    auto curve = g->add<FillCurve>(md, fill_depth, false);
+    std::vector<ValueNode*> sizes;
+    std::vector<FillCurveAve*> theos;
+    for(double size : {1.0, 4.0, 9.0, 25.0}) {
+        sizes.push_back(g->add<Const>(size));
+        theos.push_back(g->add<FillCurveAve>(curve, sizes.back()));
+    }
+    EXPECT_EQ(g->add<FillCurveAve>(curve, sizes[1]), theos[1]);
+    EXPECT_EQ(curve->numSizes(), 4u);
+
+    b.insert(md::Order{1001, Side::Bid, 5, 10.0});
+    b.insert(md::Order{1002, Side::Bid, 6, 8.0});
+    b.insert(md::Order{2001, Side::Ask, 3, 11.0});
+    b.insert(md::Order{2002, Side::Ask, 7, 12.0});
+    md->fireBookChange(msg);
+
+    for(size_t k=0; k<sizes.size(); ++k) {
+        auto bid = g->add<PriceToFill>(md, Side::Bid, sizes[k], fill_depth, false);
+        auto ask = g->add<PriceToFill>(md, Side::Ask, sizes[k], fill_depth, false);
+        md->fireBookChange(msg);
+        EXPECT_DOUBLE_EQ(curve->bidFill(k), bid->heldValue());
+        EXPECT_DOUBLE_EQ(curve->askFill(k), ask->heldValue());
+        EXPECT_DOUBLE_EQ(theos[k]->value(), (bid->heldValue() + ask->heldValue()) / (2 * sizes[k]->heldValue()));
+    }
+}
+
 TEST_F(test_theos, test_priceToFill_use_counts) {
     auto size = g->add<Const>(3.0);
     bool use_counts = true;
@@ -75,6 +75,87 @@ TEST_F(test_trade_signals, sigmoid_sv) {
 }
 
 
+TEST_F(test_trade_signals, tree_sv) {
+    auto base = g->add<Midpt>(btec);
+    auto wtave = g->add<WeightAve>(btec);
+    //split 0: wtave < 100.5 goes to split 1, else leaf 1
+    //split 1: midpt < 99 goes to leaf 0, else leaf 2
+    auto tree = g->add<TreeSV>(base, std::vector<ValueNode*>{wtave, base},
+                               std::vector<double>{100.5, 99},
+                               std::vector<int>{1, 0},
+                               std::vector<int>{-1, -2},
+                               std::vector<std::vector<int>>{{1}, {2}, {5, 50}},
+                               std::vector<std::vector<double>>{{1.0}, {1.0}, {0.1, 0.2}},
+                               std::vector<double>{0.5, 0.5, 0.5});
+    ASSERT_TRUE((tree));
+
+    md::Book bb;
+    bb.insert(md::Order{1001, Side::Bid, 100, 99.0});
+    bb.insert(md::Order{1002, Side::Ask, 200, 101.0});
+    MockBookFiniteDepthMsg msg;
+    msg.setOutrightBook(&bb);
+    btec->fireBookChange(msg);
+
+    msg.addTrade(MockBookTradeMsg{5, 101});
+    btec->fireBookChange(msg);
+    EXPECT_DOUBLE_EQ(tree->value(), 100 + 0.1 * approxSigmoid(5, 5) + 0.2 * approxSigmoid(5, 50));
+
+    msg.clearTrades();
+
+    //a child index past the end of the splits
+    EXPECT_THROW(g->add<TreeSV>(base, std::vector<ValueNode*>{wtave},
+                                std::vector<double>{100.5},
+                                std::vector<int>{3},
+                                std::vector<int>{-1},
+                                std::vector<std::vector<int>>{{1}, {2}},
+                                std::vector<std::vector<double>>{{1.0}, {1.0}},
+                                std::vector<double>{0.5, 0.5}),
+                 std::invalid_argument);
+}
+
+TEST_F(test_trade_signals, tree_forest_sv) {
+    auto base = g->add<Midpt>(btec);
+    auto wtave = g->add<WeightAve>(btec);
+    //tree 0 is the tree in tree_sv; tree 1 is a stump with a single leaf
+    auto forest = g->add<TreeForestSV>(base,
+        std::vector<std::vector<ValueNode*>>{{wtave, base}, {}},
+        std::vector<std::vector<double>>{{100.5, 99}, {}},
+        std::vector<std::vector<int>>{{1, 0}, {}},
+        std::vector<std::vector<int>>{{-1, -2}, {}},
+        std::vector<std::vector<std::vector<int>>>{{{1}, {2}, {5, 50}}, {{1}}},
+        std::vector<std::vector<std::vector<double>>>{{{1.0}, {1.0}, {0.1, 0.2}}, {{1.0}}},
+        std::vector<std::vector<double>>{{0.5, 0.5, 0.5}, {0.5}},
+        std::vector<double>{0.5, 0.5});
+    ASSERT_TRUE((forest));
+
+    md::Book bb;
+    bb.insert(md::Order{1001, Side::Bid, 100, 99.0});
+    bb.insert(md::Order{1002, Side::Ask, 200, 101.0});
+    MockBookFiniteDepthMsg msg;
+    msg.setOutrightBook(&bb);
+    btec->fireBookChange(msg);
+
+    msg.addTrade(MockBookTradeMsg{5, 101});
+    btec->fireBookChange(msg);
+    double tree_impulse = 0.1 * approxSigmoid(5, 5) + 0.2 * approxSigmoid(5, 50);
+    double stump_impulse = approxSigmoid(5, 1);
+    EXPECT_DOUBLE_EQ(forest->value(), 100 + 0.5 * tree_impulse + 0.5 * stump_impulse);
+
+    msg.clearTrades();
+
+    //tree_weight_ gives the number of trees
+    EXPECT_THROW(g->add<TreeForestSV>(base,
+        std::vector<std::vector<ValueNode*>>{{}},
+        std::vector<std::vector<double>>{{}},
+        std::vector<std::vector<int>>{{}},
+        std::vector<std::vector<int>>{{}},
+        std::vector<std::vector<std::vector<int>>>{{{1}}},
+        std::vector<std::vector<std::vector<double>>>{{{1.0}}},
+        std::vector<std::vector<double>>{{0.5}},
+        std::vector<double>{0.5, 0.5}),
+                 std::invalid_argument);
+}
+
 TEST_F(test_trade_signals, ema_sigmoid_sv) {
     ASSERT_TRUE((btec));
     
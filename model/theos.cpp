@@ -7,5 +7,7 @@ NODE_FACTORY_ADD(SizeFinder);
 NODE_FACTORY_ADD(PriceToFill);
 NODE_FACTORY_ADD(AvgPriceExec);
 NODE_FACTORY_ADD(FillAve);
+NODE_FACTORY_ADD(FillCurve);
+NODE_FACTORY_ADD(FillCurveAve);
 
 
@@ -1,5 +1,7 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
+#include <vector>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wparentheses"
@@ -7,6 +9,7 @@
 #pragma GCC diagnostic pop
 
 #include "model/graph.h"
+#include "model/book_levels.h"
 #include "model/market_data.h"
 #include "model/clocks.h"
 #include "model/serialize.h"
@@ -23,6 +26,8 @@ struct Midpt : public Theo {
         status_ = StatusCode::OK;
     }
 
+    bool stateless() const override { return true; }
+
     SERIALIZE(Midpt, market_data_);
 
     protected:
@@ -47,6 +52,8 @@ struct WeightAve : public Theo {
         status_ = StatusCode::OK;
     }
 
+    bool stateless() const override { return true; }
+
     SERIALIZE(WeightAve, market_data_);
 
     protected:
@@ -56,6 +63,8 @@ struct WeightAve : public Theo {
     }
 };
 
+//Walks the book level by level. PriceToFill reads the same result from
+//BookLevels, which shares one set of prefix sums across all its instances.
 //templated on level_size to take both size and counts, which are different types
 template<typename T>
 double priceToFillImpl(MarketData* raw_market_data, 
@@ -92,17 +101,11 @@ double priceToFillImpl(MarketData* raw_market_data,
 struct PriceToFill : public Theo {
     void compute() override {
         const bool is_ask = side_ == Side::Ask;
-        if ( use_counts_ ) {
-            vpl::Int32 const* level_count;
-            level_count = is_ask ? market_data_->askNumOrdersPtr() : market_data_->bidNumOrdersPtr();
-            value_ = priceToFillImpl(raw_market_data_, level_count, market_data_,
-                                     max_depth_, is_ask, size_->heldValue());
-        } else {
-            vpl::Int64 const* level_size;
-            level_size = is_ask ? market_data_->askSizesPtr() : market_data_->bidSizesPtr();
-            value_ = priceToFillImpl(raw_market_data_, level_size, market_data_,
-                                     max_depth_, is_ask, size_->heldValue());
-        }
+        auto inside_price = is_ask ? raw_market_data_->askPricesPtr()[0].toDouble() 
+                                   : raw_market_data_->bidPricesPtr()[0].toDouble();
+        int direction = is_ask ? 1.0 : -1.0;
+        double stop_price = inside_price + direction * market_data_->tickSize() * (max_depth_ - 1);
+        value_ = book_levels_->priceToFill(is_ask, use_counts_, size_->heldValue(), stop_price);
         status_ = StatusCode::OK;
     }
     
@@ -113,6 +116,7 @@ struct PriceToFill : public Theo {
     const size_t max_depth_;
     bool use_counts_;
     MarketData* raw_market_data_;
+    BookLevels* book_levels_;
     protected:
     PriceToFill(Graph* g, MarketData* market_data, ::Side side,
                 ValueNode* size, size_t max_depth, bool use_counts)
@@ -121,9 +125,10 @@ struct PriceToFill : public Theo {
           size_(size),
           max_depth_(max_depth),
           use_counts_(use_counts),
-          raw_market_data_(g->add<RawMarketData>(symbol())) {
+          raw_market_data_(g->add<RawMarketData>(symbol())),
+          book_levels_(g->add<BookLevels>(market_data)) {
         assert(max_depth>0);
-        setParents(size_);
+        setParents(size_, book_levels_);
         setClock(market_data_, raw_market_data_);
     }
 };
@@ -132,11 +137,11 @@ struct SizeFinder : public ValueNode {
     void compute() override {
         double size_found{0};
         if ( use_counts_ ) {
-            size_found = book_depth_->bidCountToLevel(max_depth_) + 
-                        book_depth_->askCountToLevel(max_depth_);
+            size_found = book_levels_->countToLevel(false, max_depth_) + 
+                        book_levels_->countToLevel(true, max_depth_);
         } else {
-            size_found = book_depth_->bidSizeToLevel(max_depth_) + 
-                        book_depth_->askSizeToLevel(max_depth_);
+            size_found = book_levels_->sizeToLevel(false, max_depth_) + 
+                        book_levels_->sizeToLevel(true, max_depth_);
         }
         size_found /= 2.0; //average for one side.
 
@@ -155,7 +160,7 @@ struct SizeFinder : public ValueNode {
     double size_mult_;
     int ema_length_;
     bool use_counts_;
-    BookDepth* book_depth_;
+    BookLevels* book_levels_;
     MarketData* market_data_;
     SimpleEMA simple_ema_;
     
@@ -167,12 +172,12 @@ struct SizeFinder : public ValueNode {
           size_mult_(size_mult),  
           ema_length_(ema_length),
           use_counts_(use_counts),
-          book_depth_(g->add<BookDepth>(market_data))
+          book_levels_(g->add<BookLevels>(market_data))
         , market_data_(market_data) {
         assert(size_mult>0);
         simple_ema_.setLength(ema_length);     
-        setParent(book_depth_);
-        setClock(book_depth_);
+        setParent(book_levels_);
+        setClock(book_levels_);
     }
 };
 
@@ -258,3 +263,110 @@ struct FillAve : public Theo {
     }
 };
 
+
+//Fill prices for many sizes off one book, for grabbing a whole fill curve.
+//
+//Each size is requested through a FillCurveAve view, which reads like a
+//FillAve with that size:
+//
+//    auto curve = g->add<FillCurve>(market_data, fill_depth, use_counts);
+//    auto theo = g->add<FillCurveAve>(curve, size);
+//
+//Curves are memoized on (market_data, fill_depth, use_counts) and views add
+//their size to the curve, so every view on the same book and depth shares one
+//pass over BookLevels per side. Sizes are truncated to whole units up front,
+//so that pass is a plain min/max loop across sizes, which vectorizes.
+struct FillCurve : public ValueNode {
+    void compute() override {
+        size_t n = size_nodes_.size();
+        for ( size_t k=0; k<n; ++k ) {
+            sizes_[k] = size_nodes_[k]->heldValue();
+            whole_sizes_[k] = std::trunc(sizes_[k]);
+        }
+        double tick_size = market_data_->tickSize();
+        double ask_stop = raw_market_data_->askPricesPtr()[0].toDouble() + tick_size * (fill_depth_ - 1);
+        double bid_stop = raw_market_data_->bidPricesPtr()[0].toDouble() - tick_size * (fill_depth_ - 1);
+        book_levels_->priceToFill(true, use_counts_, whole_sizes_.data(), ask_fill_.data(), n, ask_stop);
+        book_levels_->priceToFill(false, use_counts_, whole_sizes_.data(), bid_fill_.data(), n, bid_stop);
+        value_ = n > 0 ? fillAve(0) : 0;
+        status_ = StatusCode::OK;
+    }
+
+    //Returns the slot for this size, adding it if it's new.
+    size_t addSize(ValueNode* size) {
+        auto it = std::find(size_nodes_.begin(), size_nodes_.end(), size);
+        if ( it != size_nodes_.end() )
+            return it - size_nodes_.begin();
+        size_nodes_.push_back(size);
+        sizes_.push_back(0);
+        whole_sizes_.push_back(0);
+        ask_fill_.push_back(0);
+        bid_fill_.push_back(0);
+        setParent(size);
+        return size_nodes_.size() - 1;
+    }
+
+    double askFill(size_t slot) const { return ask_fill_[slot]; }
+    double bidFill(size_t slot) const { return bid_fill_[slot]; }
+    double fillAve(size_t slot) const { return (ask_fill_[slot] + bid_fill_[slot]) / (2 * sizes_[slot]); }
+    size_t numSizes() const { return size_nodes_.size(); }
+
+    std::string defaultName() const override { 
+        return getClassName() + (use_counts_?"Count":"Size") + market_data_->getName() + std::to_string(fill_depth_);
+    }
+
+    SERIALIZE(FillCurve, market_data_, fill_depth_, use_counts_);
+
+    MarketData* market_data_;
+    const size_t fill_depth_;
+    bool use_counts_;
+    MarketData* raw_market_data_;
+    BookLevels* book_levels_;
+
+    protected:
+    std::vector<ValueNode*> size_nodes_;
+    std::vector<double> sizes_, whole_sizes_, ask_fill_, bid_fill_; //by slot
+
+    FillCurve(Graph* g, MarketData* market_data, size_t fill_depth, bool use_counts)
+        : ValueNode(g, Units::PRICE),
+          market_data_(market_data),
+          fill_depth_(fill_depth),
+          use_counts_(use_counts),
+          raw_market_data_(g->add<RawMarketData>(market_data->symbol())),
+          book_levels_(g->add<BookLevels>(market_data)) {
+        assert(fill_depth>0);
+        setParent(book_levels_);
+        setClock(market_data_, raw_market_data_);
+    }
+};
+
+//One size of a FillCurve: the average of the bid and ask fill prices.
+struct FillCurveAve : public Theo {
+    void compute() override {
+        value_ = curve_->fillAve(slot_);
+        status_ = StatusCode::OK;
+    }
+
+    bool stateless() const override { return true; }
+
+    std::string defaultName() const override { 
+        return getClassName() + size_->getName() + curve_->getName();
+    }
+
+    SERIALIZE(FillCurveAve, curve_, size_);
+
+    FillCurve* curve_;
+    ValueNode* size_;
+
+    protected:
+    size_t slot_;
+
+    FillCurveAve(Graph* g, FillCurve* curve, ValueNode* size)
+        : Theo(g, curve->market_data_),
+          curve_(curve),
+          size_(size),
+          slot_(curve->addSize(size)) {
+        setParent(curve);
+        setClock(curve);
+    }
+};
@@ -1,11 +1,14 @@
 
 #include "trade_signals.h"
 
+#include <stdexcept>
+
 NODE_FACTORY_ADD(CorrSV);
 NODE_FACTORY_ADD(EMSSigmoidSV);
 NODE_FACTORY_ADD(PersistentSV);
 NODE_FACTORY_ADD(ProdSV);
 NODE_FACTORY_ADD(SigmoidSV);
+NODE_FACTORY_ADD(TreeForestSV);
 NODE_FACTORY_ADD(TreeSV);
 
 //fast approximation to a sigmoid (should be about 4 times faster, according to stackoverflow
@@ -17,6 +20,83 @@ double shrinkToZero(double a, double b) {
     return std::max(std::min(a,b), std::min(std::max(a,b),0.0)); //median
 }
 
+void ImpactForest::addTree(std::vector<ValueNode*> const& feature,
+                           std::vector<double> const& threshold,
+                           std::vector<int> const& left_idx,
+                           std::vector<int> const& right_idx,
+                           std::vector<std::vector<int> > const& stretch,
+                           std::vector<std::vector<double> > const& coeff,
+                           std::vector<double> const& decay) {
+    size_t n_splits = feature.size();
+    size_t n_leaves = decay.size();
+    std::string err = "ImpactForest::addTree : tree " + std::to_string(roots_.size()) + ": ";
+    if ( threshold.size() != n_splits or left_idx.size() != n_splits or right_idx.size() != n_splits )
+        throw std::invalid_argument(err + "feature, threshold, left_idx and right_idx must be the same length");
+    if ( stretch.size() != n_leaves or coeff.size() != n_leaves )
+        throw std::invalid_argument(err + "stretch, coeff and decay must be the same length");
+    if ( n_leaves == 0 )
+        throw std::invalid_argument(err + "no leaves");
+    for ( size_t i=0; i<n_splits; ++i ) {
+        for ( int child : {left_idx[i], right_idx[i]} ) {
+            if ( child > 0 ? size_t(child) >= n_splits : size_t(-child) >= n_leaves )
+                throw std::invalid_argument(err + "child index out of range: " + std::to_string(child));
+        }
+    }
+    for ( size_t leaf=0; leaf<n_leaves; ++leaf ) {
+        if ( stretch[leaf].size() != coeff[leaf].size() )
+            throw std::invalid_argument(err + "stretch and coeff differ in length at leaf " + std::to_string(leaf));
+    }
+
+    //every split must be reached exactly once from the root, or the walk could
+    //loop; the depth is the most splits on any path from the root to a leaf
+    uint32_t depth = 0;
+    std::vector<int> reached(n_splits, 0);
+    std::vector<std::pair<int, uint32_t> > pending{{0, 1}};
+    while ( n_splits > 0 and not pending.empty() ) {
+        int idx = pending.back().first;
+        uint32_t level = pending.back().second;
+        pending.pop_back();
+        if ( reached[idx]++ )
+            throw std::invalid_argument(err + "split reached twice: " + std::to_string(idx));
+        depth = std::max(depth, level);
+        for ( int child : {left_idx[idx], right_idx[idx]} )
+            if ( child > 0 )
+                pending.emplace_back(child, level + 1);
+    }
+
+    //splits first, then one self-looping node per leaf
+    uint32_t split_base = nodes_.size();
+    uint32_t leaf_node_base = split_base + n_splits;
+    uint32_t leaf_base = leaf_decay_.size();
+    auto node_of = [&](int child) {
+        return child > 0 ? split_base + child : leaf_node_base - child;
+    };
+    for ( size_t i=0; i<n_splits; ++i ) {
+        auto it = std::find(features_.begin(), features_.end(), feature[i]);
+        uint32_t slot = it - features_.begin();
+        if ( it == features_.end() )
+            features_.push_back(feature[i]);
+        nodes_.push_back(Node{threshold[i], slot, {node_of(left_idx[i]), node_of(right_idx[i])}});
+    }
+    leaf_of_.resize(nodes_.size(), 0);
+    size_t widest = leaf_terms_.size();
+    for ( size_t leaf=0; leaf<n_leaves; ++leaf ) {
+        uint32_t node = nodes_.size();
+        nodes_.push_back(Node{0, 0, {node, node}});
+        leaf_of_.push_back(leaf_base + leaf);
+        leaf_stretch_.insert(leaf_stretch_.end(), stretch[leaf].begin(), stretch[leaf].end());
+        leaf_coeff_.insert(leaf_coeff_.end(), coeff[leaf].begin(), coeff[leaf].end());
+        leaf_begin_.push_back(leaf_stretch_.size());
+        leaf_decay_.push_back(decay[leaf]);
+        widest = std::max(widest, stretch[leaf].size());
+    }
+    roots_.push_back(n_splits > 0 ? split_base : leaf_node_base);
+    cursor_.push_back(roots_.back());
+    max_depth_ = std::max(max_depth_, depth);
+    feature_values_.assign(std::max<size_t>(features_.size(), 1), 0);
+    leaf_terms_.assign(widest, 0);
+}
+
 std::string SignedVolume::symbol() const { return market_data_->symbol(); }
 std::string SignedVolume::shortSymbol() const { return getShortSymbol(symbol()); }
 MarketData* SignedVolume::marketData() { return market_data_; }
@@ -32,29 +32,97 @@ struct SignedVolume : ValueNode {
     SignedVolume(Graph* g, MarketData* market_data);
 };
 
+//Impact trees compiled from their json parameterization, for TreeSV and
+//TreeForestSV. Child indices in the json are > 0 for a split and <= 0 for the
+//leaf at -idx, numbered within each tree.
+//
+//All trees' splits and leaves go into one node array, where each leaf is a
+//node whose children both point back at itself. findLeaves() can then step
+//every tree one level at a time, for as many levels as the deepest tree has,
+//with no branch on whether a tree has already reached its leaf. Distinct
+//features across all trees share one slot each in a dense buffer that's
+//gathered once per evaluation, and each leaf's sigmoid terms are contiguous.
+struct ImpactForest {
+    //Throws std::invalid_argument if the tree is malformed.
+    void addTree(std::vector<ValueNode*> const& feature,
+                 std::vector<double> const& threshold,
+                 std::vector<int> const& left_idx,
+                 std::vector<int> const& right_idx,
+                 std::vector<std::vector<int> > const& stretch,
+                 std::vector<std::vector<double> > const& coeff,
+                 std::vector<double> const& decay);
+
+    size_t numTrees() const { return roots_.size(); }
+    std::vector<ValueNode*> const& features() const { return features_; }
+
+    //Reads every feature, then walks every tree to its leaf.
+    void findLeaves() {
+        for ( size_t f=0; f<features_.size(); ++f )
+            feature_values_[f] = features_[f]->heldValue();
+        size_t n = roots_.size();
+        uint32_t* cursor = cursor_.data();
+        for ( size_t t=0; t<n; ++t )
+            cursor[t] = roots_[t];
+        for ( uint32_t level=0; level<max_depth_; ++level ) {
+            for ( size_t t=0; t<n; ++t ) {
+                Node const& node = nodes_[cursor[t]];
+                cursor[t] = node.child[not (feature_values_[node.feature] < node.threshold)];
+            }
+        }
+    }
+
+    //leaf reached by tree t in the last findLeaves(), numbered across all trees
+    uint32_t leaf(size_t t) const { return leaf_of_[cursor_[t]]; }
+    double leafDecay(uint32_t leaf) const { return leaf_decay_[leaf]; }
+
+    //Sum of coeff * approxSigmoid(trade_size, stretch) over the leaf's terms.
+    //The terms are computed in one branch-free loop, which vectorizes, and
+    //then summed in order, so the result is the same as the term-by-term sum.
+    double leafImpulse(uint32_t leaf, double trade_size) {
+        size_t begin = leaf_begin_[leaf], n = leaf_begin_[leaf+1] - begin;
+        double const* stretch = leaf_stretch_.data() + begin;
+        double const* coeff = leaf_coeff_.data() + begin;
+        double* terms = leaf_terms_.data();
+        double abs_size = std::abs(trade_size);
+        for ( size_t i=0; i<n; ++i )
+            terms[i] = coeff[i] * (trade_size / (stretch[i] + abs_size));
+        double impulse = 0;
+        for ( size_t i=0; i<n; ++i )
+            impulse += terms[i];
+        return impulse;
+    }
+
+    private:
+    struct Node {
+        double threshold;
+        uint32_t feature;  //slot in feature_values_
+        uint32_t child[2]; //left, right; a leaf's children are itself
+    };
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> roots_;        //by tree
+    std::vector<uint32_t> cursor_;       //by tree
+    std::vector<uint32_t> leaf_of_;      //by node; only meaningful for leaves
+    uint32_t max_depth_{0};
+    std::vector<ValueNode*> features_;   //distinct features, by slot
+    std::vector<double> feature_values_{0}; //by slot; never empty, leaves read slot 0
+    std::vector<uint32_t> leaf_begin_{0}; //by leaf, plus one end marker
+    std::vector<double> leaf_stretch_, leaf_coeff_, leaf_decay_;
+    std::vector<double> leaf_terms_;     //scratch, as long as the widest leaf
+};
+
 //TreeSV implements a json parameterization of an impact tree
+//The json vectors are kept as given, for serialization, and compiled once in
+//the constructor into a one-tree ImpactForest.
 struct TreeSV : public Theo {
     void compute() override {
         if ( base_theo_->marketData()->isTrade() ) {
-            //find leaf node
-            int idx = 0;
-            do {
-                if ( feature_[idx]->value() < threshold_[idx] )
-                    idx = left_idx_[idx];
-                else
-                    idx = right_idx_[idx];
-            } while ( idx > 0 );
+            forest_.findLeaves();
             
             //calc leaf impulse
-            idx = abs(idx);
-            double trade_impulse = 0;
-            auto trade_size = signed_trade_size_->value();
-            for ( size_t i=0; i<stretch_[idx].size(); ++i ) {
-                auto stretch = stretch_[idx][i];
-                auto coeff = coeff_[idx][i];
-                trade_impulse += coeff * approxSigmoid(trade_size, stretch);
-            }
-            impact_decay_rate_ = decay_[idx];
+            auto leaf = forest_.leaf(0);
+            double trade_impulse = forest_.leafImpulse(leaf, signed_trade_size_->value());
+            impact_decay_rate_ = forest_.leafDecay(leaf);
             impact_theo_wgt_ = 1.0; 
             impact_theo_value_ = base_theo_->heldValue() + trade_impulse;
             value_ = impact_theo_value_;
@@ -82,6 +150,8 @@ struct TreeSV : public Theo {
     ValueNode* signed_trade_size_; 
 
     protected:
+    ImpactForest forest_;
+
     TreeSV(Graph* g, Theo* base_theo, 
               std::vector<ValueNode*> feature,
               std::vector<double> threshold,
@@ -99,12 +169,101 @@ struct TreeSV : public Theo {
           stretch_(stretch),
           coeff_(coeff),
           decay_(decay) {
+        forest_.addTree(feature_, threshold_, left_idx_, right_idx_, stretch_, coeff_, decay_);
         signed_trade_size_ = g->add<SignedTradeSize>(base_theo->marketData()); 
         setParents(base_theo_, feature_, signed_trade_size_); 
         setClock(base_theo_);
     }
 };
 
+//TreeForestSV evaluates an ensemble of impact trees, each in TreeSV's json
+//shape, with one entry per tree in every parameter vector.
+//
+//Each tree keeps its own impact and decay exactly as a TreeSV would, and the
+//value is the base theo plus the tree_weight_-weighted sum of the trees'
+//deviations from it. Weights of 1/N average N TreeSVs (bagging); weights of 1
+//add their impacts (boosting).
+struct TreeForestSV : public Theo {
+    void compute() override {
+        size_t n = forest_.numTrees();
+        if ( base_theo_->marketData()->isTrade() ) {
+            forest_.findLeaves();
+            double trade_size = signed_trade_size_->value();
+            double base = base_theo_->heldValue();
+            for ( size_t t=0; t<n; ++t ) {
+                auto leaf = forest_.leaf(t);
+                impact_theo_value_[t] = base + forest_.leafImpulse(leaf, trade_size);
+                impact_decay_rate_[t] = forest_.leafDecay(leaf);
+                impact_theo_wgt_[t] = tree_weight_[t];
+            }
+        } else {
+            for ( size_t t=0; t<n; ++t )
+                impact_theo_wgt_[t] *= impact_decay_rate_[t];
+        }
+        double base = base_theo_->heldValue();
+        value_ = base;
+        for ( size_t t=0; t<n; ++t )
+            value_ += impact_theo_wgt_[t] * (impact_theo_value_[t] - base);
+        status_ = StatusCode::OK;
+    }
+
+    std::string defaultName() const override { 
+        return getClassName() + std::to_string(tree_weight_.size()) + base_theo_->getName();
+    }
+
+    SERIALIZE(TreeForestSV, base_theo_, feature_, threshold_, left_idx_, right_idx_, 
+              stretch_, coeff_, decay_, tree_weight_);
+    
+    Theo* base_theo_;
+    std::vector<std::vector<ValueNode*> > feature_;
+    std::vector<std::vector<double> > threshold_;
+    std::vector<std::vector<int> > left_idx_;
+    std::vector<std::vector<int> > right_idx_;
+    std::vector<std::vector<std::vector<int> > > stretch_;
+    std::vector<std::vector<std::vector<double> > > coeff_;
+    std::vector<std::vector<double> > decay_;
+    std::vector<double> tree_weight_;
+
+    ValueNode* signed_trade_size_; 
+
+    protected:
+    ImpactForest forest_;
+    std::vector<double> impact_theo_value_, impact_theo_wgt_, impact_decay_rate_; //by tree
+
+    TreeForestSV(Graph* g, Theo* base_theo, 
+              std::vector<std::vector<ValueNode*> > feature,
+              std::vector<std::vector<double> > threshold,
+              std::vector<std::vector<int> > left_idx,
+              std::vector<std::vector<int> > right_idx,
+              std::vector<std::vector<std::vector<int> > > stretch,
+              std::vector<std::vector<std::vector<double> > > coeff,
+              std::vector<std::vector<double> > decay,
+              std::vector<double> tree_weight) 
+        : Theo(g, base_theo->marketData()),
+          base_theo_(base_theo),
+          feature_(feature),
+          threshold_(threshold),
+          left_idx_(left_idx),
+          right_idx_(right_idx),
+          stretch_(stretch),
+          coeff_(coeff),
+          decay_(decay),
+          tree_weight_(tree_weight) {
+        size_t n = tree_weight_.size();
+        if ( feature_.size() != n or threshold_.size() != n or left_idx_.size() != n or right_idx_.size() != n
+             or stretch_.size() != n or coeff_.size() != n or decay_.size() != n )
+            throw std::invalid_argument("TreeForestSV : every parameter needs one entry per tree");
+        for ( size_t t=0; t<n; ++t )
+            forest_.addTree(feature_[t], threshold_[t], left_idx_[t], right_idx_[t], stretch_[t], coeff_[t], decay_[t]);
+        impact_theo_value_.assign(n, 0);
+        impact_theo_wgt_.assign(n, 0);
+        impact_decay_rate_.assign(n, 0);
+        signed_trade_size_ = g->add<SignedTradeSize>(base_theo->marketData()); 
+        setParents(base_theo_, forest_.features(), signed_trade_size_); 
+        setClock(base_theo_);
+    }
+};
+
     
 //basic sigmoid trade signed volume that decays on quotes.
 struct SigmoidSV : public SignedVolume {
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <lib/vplat_log.h>
+
+#include "model/cycle_clock.h"
+
+//Small fixed pool of threads for fanning a batch of independent tasks out
+//across cores.  parallelFor() blocks until every task has run, and the calling
+//thread takes tasks as well, so a pool of N workers keeps N+1 cores busy.
+//Tasks are claimed through an atomic counter, and nothing is allocated per
+//batch, so it is cheap enough to use once per market data burst.
+//
+//Workers can be pinned to cpus, and can spin between batches before sleeping
+//on a condition variable. Spinning burns the cores but cuts the wake-up
+//latency to well under a microsecond, which is what intra-event parallelism
+//needs; after spinCycles without a batch a worker parks, so an idle pool
+//doesn't hold its cores.
+struct WorkerPool {
+    static constexpr uint64_t defaultSpinCycles = 1 << 22; //a few ms
+
+    explicit WorkerPool(size_t nWorkers, std::vector<int> const& cpus = {}, bool spin = false,
+                        uint64_t spinCycles = defaultSpinCycles)
+        : spinCycles_(spin ? spinCycles : 0) {
+        for(size_t i=0; i<nWorkers; ++i) {
+            int cpu = i < cpus.size() ? cpus[i] : -1;
+            threads_.emplace_back([this, cpu] {
+                if(cpu >= 0)
+                    pinToCpu(cpu);
+                workerLoop();
+            });
+        }
+    }
+    WorkerPool(WorkerPool const&) = delete;
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_.store(true, std::memory_order_release);
+        }
+        wake_.notify_all();
+        for(auto& t : threads_)
+            t.join();
+    }
+
+    size_t size() const { return threads_.size(); }
+
+    //Calls fun(i) for every i in [0, n). Not reentrant. If tasks throw, the
+    //rest of the batch still runs, and the first exception is rethrown here
+    //once every task is done.
+    template <typename Fun>
+    void parallelFor(size_t n, Fun const& fun) {
+        if(n == 0)
+            return;
+        if(n == 1 or threads_.empty()) {
+            for(size_t i=0; i<n; ++i)
+                fun(i);
+            return;
+        }
+        bool wake;
+        {
+            //Workers still draining the previous batch read its state, so
+            //wait for them before overwriting it.
+            std::unique_lock<std::mutex> lock(mutex_);
+            while(active_.load(std::memory_order_acquire) != 0) {
+                lock.unlock();
+                std::this_thread::yield();
+                lock.lock();
+            }
+            task_ = &fun;
+            invoke_ = [](void const* f, size_t i) { (*static_cast<Fun const*>(f))(i); };
+            nTasks_ = n;
+            next_.store(0, std::memory_order_relaxed);
+            remaining_.store(n, std::memory_order_relaxed);
+            generation_.fetch_add(1, std::memory_order_release);
+            //workers park under the lock, so none can be missed here
+            wake = parked_ != 0;
+        }
+        if(wake)
+            wake_.notify_all();
+        runTasks();
+        while(remaining_.load(std::memory_order_acquire) != 0)
+            if(spinCycles_ == 0)
+                std::this_thread::yield();
+        if(error_) {
+            std::exception_ptr error = error_;
+            error_ = nullptr;
+            std::rethrow_exception(error);
+        }
+    }
+
+    //Returns false, and logs, if the thread couldn't be pinned.
+    static bool pinToCpu(int cpu) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if(rc != 0)
+            LOG_INFO() << "WorkerPool: failed to pin worker to cpu " << cpu << ": " << std::strerror(rc);
+        return rc == 0;
+    }
+
+    private:
+    void runTasks() {
+        for(;;) {
+            size_t i = next_.fetch_add(1, std::memory_order_relaxed);
+            if(i >= nTasks_)
+                break;
+            try {
+                invoke_(task_, i);
+            } catch(...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if(not error_)
+                    error_ = std::current_exception();
+            }
+            remaining_.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    void workerLoop() {
+        size_t seen = 0;
+        for(;;) {
+            if(spinCycles_) {
+                uint64_t start = readCycles();
+                while(generation_.load(std::memory_order_acquire) == seen
+                      and not stop_.load(std::memory_order_acquire)
+                      and readCycles() - start < spinCycles_)
+                    ;
+            }
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                ++parked_;
+                wake_.wait(lock, [&] {
+                    return stop_.load(std::memory_order_relaxed)
+                        or generation_.load(std::memory_order_relaxed) != seen;
+                });
+                --parked_;
+                if(stop_.load(std::memory_order_relaxed))
+                    return;
+                seen = generation_.load(std::memory_order_relaxed);
+                active_.fetch_add(1, std::memory_order_relaxed);
+            }
+            runTasks();
+            active_.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    void const* task_{nullptr};
+    void (*invoke_)(void const*, size_t){nullptr};
+    size_t nTasks_{0};
+    std::exception_ptr error_; //first exception of the batch, under mutex_
+    std::atomic<size_t> generation_{0};
+    std::atomic<size_t> next_{0};
+    std::atomic<size_t> remaining_{0};
+    std::atomic<size_t> active_{0}; //workers inside runTasks()
+    std::atomic<bool> stop_{false};
+    size_t parked_{0}; //workers waiting on wake_, under mutex_
+    uint64_t spinCycles_; //0 if workers don't spin
+};